@@ -9,8 +9,11 @@
 #include <device.h>
 #include <string.h>
 #include <soc.h>
+#include <watchdog.h>
 #include "../../zepboot/include/zb_flash.h"
 #include "../../zepboot/include/zb_move.h"
+#include "../../zepboot/include/zb_ret.h"
+#include "../../zepboot/include/zb_handoff.h"
 
 #include <logging/log.h>
 LOG_MODULE_REGISTER(main);
@@ -32,32 +35,297 @@ static void do_boot(off_t load_address)
     ((void (*)(void))vt->reset)();
 }
 
+/*
+ * The boot options (warm reset fast path, rotating verification, RAM image
+ * verification, handoff record, segments and watchdog) are set in the
+ * bootloader Kconfig (CONFIG_ZB_BOOT_*).
+ */
+#ifdef CONFIG_ZB_BOOT_VERIFY_SECTORS
+#define BOOT_VERIFY_SECTORS CONFIG_ZB_BOOT_VERIFY_SECTORS
+#else
+#define BOOT_VERIFY_SECTORS 0
+#endif
+
+#ifdef CONFIG_ZB_BOOT_RETAINED
+static struct zb_ret boot_ret __noinit;
+#endif
+
+/* next sector of the rotating verification */
+static u32_t boot_vfy_sect;
+
+/*
+ * Maximum number of slot areas (the swap masks in the handoff record are 32 bit)
+ */
+#define BOOT_AREA_MAX 32
+
+#ifdef CONFIG_ZB_BOOT_WATCHDOG
+static struct device *boot_wdt;
+static int boot_wdt_channel;
+
+static void boot_wdt_init(void)
+{
+	struct wdt_timeout_cfg cfg = {
+		.window.min = 0U,
+		.window.max = CONFIG_ZB_BOOT_WATCHDOG_TIMEOUT_MS,
+		.callback = NULL,
+		.flags = WDT_FLAG_RESET_SOC,
+	};
+
+	boot_wdt = device_get_binding(DT_WDT_0_NAME);
+	if (!boot_wdt) {
+		LOG_ERR("No watchdog");
+		return;
+	}
+	boot_wdt_channel = wdt_install_timeout(boot_wdt, &cfg);
+	if ((boot_wdt_channel < 0) || wdt_setup(boot_wdt, 0)) {
+		LOG_ERR("Watchdog setup failed");
+		boot_wdt = NULL;
+	}
+}
+#endif
+
+static void boot_wdt_feed(void)
+{
+#ifdef CONFIG_ZB_BOOT_WATCHDOG
+	if (boot_wdt) {
+		(void)wdt_feed(boot_wdt, boot_wdt_channel);
+	}
+#endif
+}
+
+#ifdef CONFIG_ZB_BOOT_WATCHDOG
+/* Replaces the default in zb_ec256.c, called during the image hash */
+void zb_wdt_feed(void)
+{
+	boot_wdt_feed();
+}
+#endif
+
+static void boot_verify_report(struct zb_slt_area *area, zb_img_info *info,
+			       u8_t slt, u32_t sect_cnt)
+{
+	u32_t crc32, tbl_crc32, sect;
+
+	for (sect = 0; sect < sect_cnt; sect++) {
+		if (zb_crc_tbl_read(area, slt, sect, &tbl_crc32) ||
+		    zb_img_calc_sect_crc32(info, sect, &crc32)) {
+			continue;
+		}
+		if (crc32 != tbl_crc32) {
+			LOG_ERR("Slot %d sector %d corrupted", slt, sect);
+		}
+	}
+}
+
+static int boot_verify_sect(struct zb_slt_area *area, zb_img_info *info,
+			    u8_t slt, u32_t sect)
+{
+	u32_t crc32, tbl_crc32;
+
+	if (zb_crc_tbl_read(area, slt, sect, &tbl_crc32) ||
+	    zb_img_calc_sect_crc32(info, sect, &crc32) ||
+	    (crc32 != tbl_crc32)) {
+		LOG_ERR("Slot %d sector %d corrupted", slt, sect);
+		return -EFAULT;
+	}
+	return 0;
+}
+
+/* Verify the image before boot, on a warm reset of the same image only the
+ * first sector and BOOT_VERIFY_SECTORS rotating sectors are verified (or none
+ * when BOOT_VERIFY_SECTORS is 0).
+ */
+static int boot_verify(struct zb_slt_area *area, zb_img_info *info, u8_t slt,
+		       u32_t img_crc32, bool warm)
+{
+	u32_t crc32, sect, sect_cnt, cnt;
+
+	if (warm && (BOOT_VERIFY_SECTORS == 0)) {
+		LOG_INF("Warm reset: skipping verification");
+		return 0;
+	}
+
+	sect_cnt = (info->end - info->start + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	if (!sect_cnt) {
+		LOG_ERR("Slot %d image is empty", slt);
+		return -EFAULT;
+	}
+
+	if (warm && (!zb_crc_tbl_read(area, slt, 0, &crc32))) {
+		LOG_INF("Warm reset: verifying %d sectors", BOOT_VERIFY_SECTORS);
+		if (boot_verify_sect(area, info, slt, 0)) {
+			return -EFAULT;
+		}
+		sect = boot_vfy_sect % sect_cnt;
+		for (cnt = 0; cnt < MIN(BOOT_VERIFY_SECTORS, sect_cnt); cnt++) {
+			if (boot_verify_sect(area, info, slt, sect)) {
+				return -EFAULT;
+			}
+			sect = (sect + 1) % sect_cnt;
+		}
+		boot_vfy_sect = sect;
+		return 0;
+	}
+
+	boot_vfy_sect = 0;
+	zb_img_calc_crc32(info, &crc32);
+	if (crc32 != img_crc32) {
+		boot_verify_report(area, info, slt, sect_cnt);
+		return -EFAULT;
+	}
+	return 0;
+}
+
+/* Copy a RAM image and verify the copy */
+static int boot_ram_load(zb_img_info *info, u32_t img_crc32)
+{
+#ifdef CONFIG_ZB_BOOT_RAM_VERIFY
+	int rc;
+
+	if (info->enc_start == info->end) {
+		rc = zb_img_ram_move(info);
+		if (!rc) {
+			rc = zb_img_ram_verify(info, img_crc32);
+		}
+		return rc;
+	}
+#endif
+	return zb_img_ram_load(info, img_crc32);
+}
+
+/* Start or continue the swap in area one step at a time, the swap stops when
+ * budget_ms (0: no budget) has passed since start_ms and is continued on a
+ * later boot
+ */
+static int boot_swap(struct zb_slt_area *area, u32_t budget_ms, u32_t start_ms,
+		     bool *swapped, bool *deferred)
+{
+	zb_img_swp_step step;
+	int rc;
+
+	*deferred = false;
+	rc = zb_img_swap_begin(area, &step);
+	*swapped = (step.phase != CMD2_SWP_END);
+	while (step.phase != CMD2_SWP_END) {
+		if (budget_ms && ((k_uptime_get_32() - start_ms) >= budget_ms)) {
+			LOG_INF("Swap budget spent [%d steps left]",
+				step.remaining);
+			*deferred = true;
+			return 0;
+		}
+		boot_wdt_feed();
+		rc = zb_img_swap_step(area, &step);
+		if (rc != -EAGAIN) {
+			break;
+		}
+	}
+	return rc;
+}
+
+/* Slot areas are swapped in order of prio (lowest value first), areas with the
+ * same prio in reverse slot_map order
+ */
+static void boot_swap_order(u8_t *order, int cnt)
+{
+	struct zb_slt_area area;
+	u8_t prio[BOOT_AREA_MAX], tmp;
+	int i, j;
+
+	for (i = 0; i < cnt; i++) {
+		order[i] = cnt - 1 - i;
+		/* a area that can't be read fails in the swap */
+		prio[i] = zb_slt_area_get(&area, order[i]) ? 0 : area.prio;
+		for (j = i; (j > 0) && (prio[j - 1] > prio[j]); j--) {
+			tmp = prio[j];
+			prio[j] = prio[j - 1];
+			prio[j - 1] = tmp;
+			tmp = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = tmp;
+		}
+	}
+}
+
+/* Check if the previous boot used the same image (warm reset) */
+static bool boot_warm(bool warm, off_t boot_address, u32_t img_crc32)
+{
+#ifdef CONFIG_ZB_BOOT_RETAINED
+	return (warm && (boot_ret.boot_address == boot_address) &&
+		(boot_ret.img_crc32 == img_crc32));
+#else
+	return false;
+#endif
+}
+
 void main(void)
 {
-	int rc = 0, cnt;
+	int rc = 0, cnt, i, boot_rc = 0;
 	struct zb_slt_area area;
 	struct zb_prm prm;
 	struct zb_cmd cmd;
+	struct zb_idle idle;
 	zb_img_info info;
-	u32_t crc32;
+	bool warm = false, swapped, deferred;
+	u32_t swp_mask = 0, swp_defer = 0, swp_ms;
+	u8_t swp_err = 0, order[BOOT_AREA_MAX];
+
+	cnt = MIN(zb_slt_area_cnt(), BOOT_AREA_MAX);
+	swp_ms = k_uptime_get_32();
+
+#ifdef CONFIG_ZB_BOOT_RETAINED
+	warm = (zb_ret_read(&boot_ret) == 0);
+	if (warm) {
+		boot_vfy_sect = boot_ret.vfy_sect;
+	}
+#endif
 
-	cnt = zb_slt_area_cnt();
+#ifdef CONFIG_ZB_BOOT_WATCHDOG
+	boot_wdt_init();
+#endif
 
-	/* Start or continue swap */
-	while ((cnt--) > 0) {
-		rc = zb_slt_area_get(&area, cnt);
+	/* Start or continue swap, the booted area (slot_map[0]) has no budget */
+	boot_swap_order(order, cnt);
+	for (i = 0; i < cnt; i++) {
+		rc = zb_slt_area_get(&area, order[i]);
 		if (!rc) {
-			rc = zb_img_swap(&area);
+			if (zb_idle_read(&area, &idle)) {
+				/* pending (or unknown) commands */
+				warm = false;
+			}
+			rc = boot_swap(&area, order[i] ? area.swp_budget_ms : 0,
+				       swp_ms, &swapped, &deferred);
+			if (swapped) {
+				swp_mask |= BIT(order[i]);
+			}
+			if (deferred) {
+				swp_defer |= BIT(order[i]);
+			}
+		}
+		if (rc) {
+			swp_err = 1;
+		}
+		if (order[i] == 0) {
+			boot_rc = rc;
 		}
 	}
+	swp_ms = k_uptime_get_32() - swp_ms;
+	boot_wdt_feed();
 
-	/* Boot is done for images slot_map[0], area is already set OK */
+	/* Boot is done for images slot_map[0] */
+	rc = boot_rc;
+	if (!rc) {
+		rc = zb_slt_area_get(&area, 0);
+	}
 	if (!rc) {
 		rc = zb_prm_read(&area, &prm);
 	}
 
 	if (!rc) {
-		zb_cmd_read_slt1end(&area, &cmd);
+		if (!zb_idle_read(&area, &idle)) {
+			cmd.cmd1 = idle.cmd1;
+		} else {
+			zb_cmd_read_slt1end(&area, &cmd);
+		}
 		if (cmd.cmd1 == CMD1_MASK_BT0_REQUEST) {
 			prm.pri_ld_address = prm.sec_ld_address;
 		}
@@ -65,24 +333,77 @@ void main(void)
 
 	/* Verify crc32 prior to boot */
 	if ((!rc) && zb_in_slt_area(&area, 1, prm.pri_ld_address)) {
-		zb_img_get_info_nsc(&info, &area, 1, 0, false);
-		zb_img_calc_crc32(&info, &crc32);
-		if (prm.slt1_crc32 != crc32) {
+		if (zb_img_get_info_prm(&info, &area, &prm, 1)) {
+			zb_img_get_info_nsc(&info, &area, 1, 0, false);
+		}
+		if (boot_verify(&area, &info, 1, prm.slt1_crc32,
+				boot_warm(warm, prm.pri_ld_address,
+					  prm.slt1_crc32))) {
 			prm.pri_ld_address = prm.sec_ld_address;
 		}
 	}
 
 	if ((!rc) && (zb_in_slt_area(&area, 0, prm.pri_ld_address) ||
 		      zb_in_ram(prm.pri_ld_address))) {
-		zb_img_get_info_nsc(&info, &area, 0, 0, false);
-		zb_img_calc_crc32(&info, &crc32);
-		if (prm.slt0_crc32 != crc32) {
+		if (zb_img_get_info_prm(&info, &area, &prm, 0) ||
+		    (zb_in_ram(prm.pri_ld_address) &&
+		     (prm.slt0_flags & ZB_PRM_FLAG_ENC))) {
+			/* the key of encrypted RAM images is derived from
+			 * the tlv area
+			 */
+			zb_img_get_info_nsc(&info, &area, 0, 0, false);
+		}
+		if (zb_in_ram(prm.pri_ld_address)) {
+			if (boot_warm(warm, prm.pri_ld_address,
+				      prm.slt0_crc32) &&
+			    (!zb_img_ram_verify(&info, prm.slt0_crc32))) {
+				LOG_INF("Warm reset: RAM image is valid");
+			} else {
+				rc = boot_ram_load(&info, prm.slt0_crc32);
+			}
+		} else if (boot_verify(&area, &info, 0, prm.slt0_crc32,
+				       boot_warm(warm, prm.pri_ld_address,
+						 prm.slt0_crc32))) {
 			rc = -EFAULT;
 		}
-		if ((!rc) && zb_in_ram(prm.pri_ld_address)) {
-			rc = zb_img_ram_move(&info);
+	}
+
+#ifdef CONFIG_ZB_BOOT_SEGMENTS
+	/* info has the segment table of the image that is booted */
+	if ((!rc) && (zb_in_slt_area(&area, 1, prm.pri_ld_address) ||
+		      zb_in_slt_area(&area, 0, prm.pri_ld_address))) {
+		rc = zb_img_seg_load(&info);
+	}
+#endif
+
+#ifdef CONFIG_ZB_BOOT_RETAINED
+	if (!rc) {
+		if (zb_in_slt_area(&area, 1, prm.pri_ld_address)) {
+			zb_ret_write(&boot_ret, prm.pri_ld_address,
+				     prm.slt1_crc32, boot_vfy_sect);
+		} else {
+			zb_ret_write(&boot_ret, prm.pri_ld_address,
+				     prm.slt0_crc32, boot_vfy_sect);
 		}
+	} else {
+		zb_ret_clear(&boot_ret);
+	}
+#endif
+
+#ifdef CONFIG_ZB_BOOT_HANDOFF
+	if (!rc) {
+		struct zb_handoff *ho = (struct zb_handoff *)ZB_HANDOFF_ADDRESS;
+
+		ho->slt = zb_in_slt_area(&area, 1, prm.pri_ld_address) ? 1 : 0;
+		ho->swp_err = swp_err;
+		ho->swp_mask = swp_mask;
+		ho->swp_defer = swp_defer;
+		ho->swp_ms = swp_ms;
+		ho->boot_ms = k_uptime_get_32();
+		ho->prm = prm;
+		zb_handoff_write(ho, &info);
 	}
+#endif
 
 	if (!rc) {
 		LOG_INF("Ready to boot [addr %x]", prm.pri_ld_address);
@@ -26,6 +26,9 @@ const struct slt_area slot_map[] = {
 	 .slt0_devname = DT_FLASH_AREA_0_DEV,
 	 .slt1_devname = DT_FLASH_AREA_0_DEV,
 	 .swpstat_devname = DT_FLASH_AREA_0_DEV,
+	 .scratch_cnt = 0,
+	 .prio = 0,
+	 .swp_budget_ms = 0,
 	},
 };
 
@@ -22,8 +22,10 @@ from . import version as versmod
 from intelhex import IntelHex
 import hashlib
 import struct
+import zlib
 import os.path
 import imgtool.keys as keys
+import imgtool.lz as lz
 from cryptography.hazmat.primitives.asymmetric import padding
 from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
 from cryptography.hazmat.backends import default_backend
@@ -33,8 +35,22 @@ MIN_IMAGE_OFFSET = 512
 TLV_AREA_MAGIC = 0x544c5641
 TLVE_IMAGE_TYPE = 0x10
 TLVE_IMAGE_INFO = 0x20
+TLVE_IMAGE_SEG = 0x21
 TLVE_IMAGE_HASH = 0x30
+TLVE_IMAGE_PHASH = 0x31
+TLVE_IMAGE_SECT_HASH = 0x32
+TLVE_IMAGE_HASH_TYPE = 0x33
 TLVE_IMAGE_EPUBKEY = 0x40
+TLVE_IMAGE_ENC_TYPE = 0x41
+TLVE_KEY_ID = 0x50
+TLVE_IMAGE_CMP = 0x60
+TLVE_IMAGE_DELTA = 0x61
+TLVA_SIG_TYPE = {'ec256': 0x00, 'ed25519': 0x01}
+HASH_TYPE = {'sha256': 0x00, 'blake2s': 0x01}
+ENC_TYPE = {'aes128-ctr': 0x00, 'chacha20': 0x01}
+SEG_FLAGS = {'load': 0x01, 'zero': 0x02, 'list': 0x00}
+SEG_SIZE = 16
+KEY_ID_SIZE = 4
 
 BIN_EXT = "bin"
 INTEL_HEX_EXT = "hex"
@@ -56,6 +72,9 @@ class Image():
         self.endian = endian
         self.payload = []
         self.size = 0
+        # slot offset of the compressed stream, the space between the header
+        # area and the stream is not saved
+        self.stream_offset = None
 
     def __repr__(self):
         return "<image_offset={}, slot_size={}, align={}, slot_address={}, \
@@ -92,19 +111,34 @@ class Image():
 
         self.check()
 
+    def parts(self):
+        """Parts of the image that are saved as (slot offset, data)"""
+        if self.stream_offset is None:
+            return [(0, bytes(self.payload))]
+        return [(0, bytes(self.payload[:self.image_offset])),
+                (self.stream_offset, bytes(self.payload[self.stream_offset:]))]
+
     def save(self, path):
-        """Save an image from a given file"""
+        """Save an image from a given file
+
+        For a compressed image only the header area and the stream are
+        saved: a hex file places the stream at its slot address, in a binary
+        file the stream directly follows the header area and has to be
+        written at stream_offset in the slot.
+        """
         ext = os.path.splitext(path)[1][1:].lower()
         if ext == INTEL_HEX_EXT:
             # input was in binary format, but HEX needs to know the base addr
             if self.slot_address is None:
                 raise Exception("Input file does not provide a slot address")
             h = IntelHex()
-            h.frombytes(bytes=self.payload, offset=self.slot_address)
+            for offset, data in self.parts():
+                h.frombytes(bytes=data, offset=self.slot_address + offset)
             h.tofile(path, 'hex')
         else:
             with open(path, 'wb') as f:
-                f.write(self.payload)
+                for offset, data in self.parts():
+                    f.write(data)
 
     def check(self):
         """Perform some sanity checking of the image."""
@@ -121,7 +155,36 @@ class Image():
                         len(self.payload), self.slot_size)
                 raise Exception(msg)
 
-    def create(self, signkey, encrkey):
+    def new_hash(self, data = b''):
+        """Image hash object of the selected hash type."""
+        if self.hash_type == 'blake2s':
+            return hashlib.blake2s(data, digest_size = 32)
+        return hashlib.sha256(data)
+
+    def create(self, signkey, encrkey, plainhash = False, sector_size = None,
+               hash_type = 'sha256', cipher = 'aes128-ctr',
+               compress_size = None, base = None, base_version = None,
+               segments = None):
+
+        self.hash_type = hash_type
+        self.cipher = cipher
+        seg = self.segment_table(segments) if segments else None
+
+        if compress_size is not None and sector_size is not None:
+            raise Exception("Sector hash is not supported for compressed \
+            images")
+
+        if base is not None and compress_size is None:
+            raise Exception("Delta images require compression")
+
+        # Calculate the hash of the unencrypted image.
+        phash = None
+        if plainhash:
+            phash = self.new_hash(self.payload[self.image_offset:]).digest()
+
+        stream = None
+        if compress_size is not None:
+            stream, restarts = self.compress(compress_size, base)
 
         epubk = None
         if encrkey is not None:
@@ -137,27 +200,137 @@ class Image():
             sha = hashlib.sha256()
             sha.update(shared_secret)
             sha.update(b'\x00\x00\x00\x00')
-            plainkey = sha.digest()[:16]
-
-            # Encrypt
+            # Encrypt, the nonce (and initial counter) is zero
             nonce = bytes([0] * 16)
-            cipher = Cipher(algorithms.AES(plainkey), modes.CTR(nonce),
-                            backend=default_backend())
+            if self.cipher == 'chacha20':
+                plainkey = sha.digest()
+                cipher = Cipher(algorithms.ChaCha20(plainkey, nonce),
+                                mode = None, backend=default_backend())
+            else:
+                plainkey = sha.digest()[:16]
+                cipher = Cipher(algorithms.AES(plainkey), modes.CTR(nonce),
+                                backend=default_backend())
             encryptor = cipher.encryptor()
-            msg = bytes(self.payload[self.image_offset:])
+            if stream is not None:
+                # The compressed stream is encrypted
+                stream = encryptor.update(stream) + encryptor.finalize()
+            else:
+                msg = bytes(self.payload[self.image_offset:])
+
+                enc = encryptor.update(msg) + encryptor.finalize()
+                self.payload = bytearray(self.payload)
+                self.payload[self.image_offset:] = enc
+
+        cmp = None
+        if stream is not None:
+            cmp = self.add_compressed(stream, restarts, compress_size)
+            cmp_start = struct.unpack(STRUCT_ENDIAN_DICT[self.endian] + 'I',
+                                      cmp[:4])[0]
+            # The image hash covers the stream and the restart table
+            hash = self.new_hash(self.payload[cmp_start:]).digest()
+        else:
+            # Calculate the image hash.
+            hash = self.new_hash(self.payload[self.image_offset:]).digest()
 
-            enc = encryptor.update(msg) + encryptor.finalize()
-            self.payload = bytearray(self.payload)
-            self.payload[self.image_offset:] = enc
+        sect_hash = None
+        if sector_size is not None:
+            sect_hash = self.add_sector_hash_table(sector_size)
 
-        # Calculate the image hash.
-        sha = hashlib.sha256()
-        sha.update(self.payload[self.image_offset:])
-        hash = sha.digest()
+        delta = None
+        if base is not None:
+            delta = self.delta_info(base, base_version)
+
+        self.add_header(hash, epubk, signkey, phash, sect_hash, cmp, delta,
+                        seg)
+
+    def segment_table(self, segments):
+        """Segment table tlv value, segments is a list of (offset, size,
+        load address, flags) with flags one of SEG_FLAGS"""
+        if len(segments) * SEG_SIZE > 255:
+            raise Exception("Too many segments")
+        e = STRUCT_ENDIAN_DICT[self.endian]
+        table = b''
+        for offset, size, address, flags in segments:
+            if flags == 'load' and offset + size > self.size:
+                raise Exception("Segment at 0x{:x} outside image".format(
+                                offset))
+            table += struct.pack(e + 'IIII', offset, size, address,
+                                 SEG_FLAGS[flags])
+        return table
+
+    def sectors(self, sector_size):
+        """Image data (start, end) in each sector of the expanded image"""
+        end = self.image_offset + self.size
+        return [(max(0, s - self.image_offset),
+                 max(0, min(end, s + sector_size) - self.image_offset))
+                for s in range(0, end, sector_size)]
+
+    def compress(self, sector_size, base = None):
+        """Compress the image (as a delta to base when given), returns the
+        stream and the restart table"""
+        return lz.compress(bytes(self.payload[self.image_offset:]),
+                           self.sectors(sector_size), base or b'')
+
+    def delta_info(self, base, base_version):
+        """Delta image tlv value: the version and crc32 of the base image as
+        they are kept by the bootloader for slot 0"""
+        e = STRUCT_ENDIAN_DICT[self.endian]
+        version = ((base_version.major << 24) |
+                   ((base_version.minor or 0) << 16) |
+                   (base_version.revision or 0))
+        return struct.pack(e + 'II', version, zlib.crc32(base) & 0xffffffff)
+
+    def add_compressed(self, stream, restarts, sector_size):
+        """Replace the image by the compressed stream and the restart table,
+        returns the compressed image tlv value.
+
+        The stream is placed so that the data of each sector is located at or
+        after that sector: the swap overwrites slot 1 sector by sector. The
+        space before the stream is only kept in the payload, it is not saved
+        (see save()).
+        """
+        start = self.image_offset
+        sectors = self.sectors(sector_size)
+        for sect, restart in enumerate(restarts):
+            if sectors[sect][0] < sectors[sect][1]:
+                start = max(start, sect * sector_size - restart)
+        start += (-start) % self.align
+
+        e = STRUCT_ENDIAN_DICT[self.endian]
+        table = b''.join(struct.pack(e + 'I', r) for r in restarts)
+
+        self.payload = bytearray(self.payload[:self.image_offset])
+        self.payload += b'\xff' * (start - self.image_offset)
+        self.payload += stream
+        while (len(self.payload) % self.align) != 0:
+            self.payload += b'\xff'
+        self.payload += table
+        self.check()
+        self.stream_offset = start
+
+        return struct.pack(e + 'III', start, len(stream), sector_size)
+
+    def add_sector_hash_table(self, sector_size):
+        """Append the sector hash table, returns the sector hash tlv value"""
+        end = len(self.payload)
+        table = b''
+        for sect_start in range(0, end, sector_size):
+            start = max(self.image_offset, sect_start)
+            stop = max(start, min(end, sect_start + sector_size))
+            table += self.new_hash(self.payload[start:stop]).digest()
 
-        self.add_header(hash, epubk, signkey)
+        self.payload = bytearray(self.payload)
+        while (len(self.payload) % self.align) != 0:
+            self.payload += b'\xff'
+        self.payload += table
+        self.check()
+
+        e = STRUCT_ENDIAN_DICT[self.endian]
+        return (struct.pack(e + 'I', sector_size) +
+                self.new_hash(table).digest())
 
-    def add_header(self, hash, epubk, signkey):
+    def add_header(self, hash, epubk, signkey, phash = None, sect_hash = None,
+                   cmp = None, delta = None, seg = None):
         """Install the image header."""
 
         # Image info TLV
@@ -187,15 +360,57 @@ class Image():
         tlv_area += struct.pack('B', len(img_info))
         tlv_area += img_info
 
+        if seg is not None:
+            tlv_area += struct.pack('B', TLVE_IMAGE_SEG)
+            tlv_area += struct.pack('B', len(seg))
+            tlv_area += seg
+
         tlv_area += struct.pack('B', TLVE_IMAGE_HASH)
         tlv_area += struct.pack('B', len(hash))
         tlv_area += hash
 
+        if phash is not None:
+            tlv_area += struct.pack('B', TLVE_IMAGE_PHASH)
+            tlv_area += struct.pack('B', len(phash))
+            tlv_area += phash
+
+        if sect_hash is not None:
+            tlv_area += struct.pack('B', TLVE_IMAGE_SECT_HASH)
+            tlv_area += struct.pack('B', len(sect_hash))
+            tlv_area += sect_hash
+
+        if cmp is not None:
+            tlv_area += struct.pack('B', TLVE_IMAGE_CMP)
+            tlv_area += struct.pack('B', len(cmp))
+            tlv_area += cmp
+
+        if delta is not None:
+            tlv_area += struct.pack('B', TLVE_IMAGE_DELTA)
+            tlv_area += struct.pack('B', len(delta))
+            tlv_area += delta
+
+        if self.hash_type != 'sha256':
+            tlv_area += struct.pack('B', TLVE_IMAGE_HASH_TYPE)
+            tlv_area += struct.pack('B', 1)
+            tlv_area += struct.pack('B', HASH_TYPE[self.hash_type])
+
         if epubk is not None:
             tlv_area += struct.pack('B', TLVE_IMAGE_EPUBKEY)
             tlv_area += struct.pack('B', len(epubk))
             tlv_area += epubk
 
+            if self.cipher != 'aes128-ctr':
+                tlv_area += struct.pack('B', TLVE_IMAGE_ENC_TYPE)
+                tlv_area += struct.pack('B', 1)
+                tlv_area += struct.pack('B', ENC_TYPE[self.cipher])
+
+        # Key id of the signing key: truncated hash of its public key
+        keyid = hashlib.sha256(
+                signkey.get_public_key_bytearray()).digest()[:KEY_ID_SIZE]
+        tlv_area += struct.pack('B', TLVE_KEY_ID)
+        tlv_area += struct.pack('B', len(keyid))
+        tlv_area += keyid
+
         sha = hashlib.sha256()
         sha.update(tlv_area)
         tlv_hash = sha.digest()
@@ -215,7 +430,7 @@ class Image():
                 TLV_AREA_MAGIC,
                 0,
                 0,
-                0
+                TLVA_SIG_TYPE[signkey.shortname()]
                 )
 
         hdr += tlv_signature
@@ -231,7 +446,7 @@ class Image():
                 TLV_AREA_MAGIC,
                 hdr_len,
                 0,
-                0
+                TLVA_SIG_TYPE[signkey.shortname()]
                 )
 
         hdr += tlv_signature
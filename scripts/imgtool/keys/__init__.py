@@ -20,8 +20,10 @@ Cryptographic key management for imgtool.
 from cryptography.hazmat.backends import default_backend
 from cryptography.hazmat.primitives import serialization
 from cryptography.hazmat.primitives.asymmetric.ec import EllipticCurvePrivateKey, EllipticCurvePublicKey
+from cryptography.hazmat.primitives.asymmetric.ed25519 import Ed25519PrivateKey, Ed25519PublicKey
 
 from .ec import EC256P1, EC256P1Public, ECUsageError
+from .ed25519 import Ed25519, Ed25519Public, Ed25519UsageError
 
 class PasswordRequired(Exception):
     """Raised to indicate that the key is password protected, but a
@@ -63,5 +65,9 @@ def load(path, passwd=None):
         if pk.key_size != 256:
             raise Exception("Unsupported EC size: " + pk.key_size)
         return EC256P1Public(pk)
+    elif isinstance(pk, Ed25519PrivateKey):
+        return Ed25519(pk)
+    elif isinstance(pk, Ed25519PublicKey):
+        return Ed25519Public(pk)
     else:
         raise Exception("Unknown key type: " + str(type(pk)))
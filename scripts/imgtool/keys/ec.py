@@ -14,7 +14,7 @@ class ECUsageError(Exception):
     pass
 
 class EC256P1Public(KeyClass):
-    def __init__(self, key, endian):
+    def __init__(self, key, endian=None):
         self.key = key
 
     def shortname(self):
@@ -30,10 +30,19 @@ class EC256P1Public(KeyClass):
         return self.key
 
     def get_public_key_bytearray(self):
-        pubkey = self.key.public_key().public_numbers().x.to_bytes(32,'big')
-        pubkey += self.key.public_key().public_numbers().y.to_bytes(32,'big')
+        pubkey = self._get_public().public_numbers().x.to_bytes(32,'big')
+        pubkey += self._get_public().public_numbers().y.to_bytes(32,'big')
         return pubkey
 
+    def validate_public(self):
+        """Check that the public key is a valid point on the curve."""
+        try:
+            ec.EllipticCurvePublicKey.from_encoded_point(ec.SECP256R1(),
+                    b'\x04' + self.get_public_key_bytearray())
+        except ValueError:
+            return False
+        return True
+
     def get_public_bytes(self):
 
         return self._get_public().public_bytes(
@@ -0,0 +1,99 @@
+"""
+ED25519 key management
+"""
+
+from cryptography.hazmat.primitives import serialization
+from cryptography.hazmat.primitives.asymmetric import ed25519
+
+from .general import KeyClass
+
+class Ed25519UsageError(Exception):
+    pass
+
+class Ed25519Public(KeyClass):
+    def __init__(self, key, endian=None):
+        self.key = key
+
+    def shortname(self):
+        return "ed25519"
+
+    def get_public_key_size(self):
+        return 32
+
+    def _unsupported(self, name):
+        raise Ed25519UsageError("Operation {} requires private key".format(name))
+
+    def _get_public(self):
+        return self.key
+
+    def get_public_key_bytearray(self):
+        return self._get_public().public_bytes(
+                encoding=serialization.Encoding.Raw,
+                format=serialization.PublicFormat.Raw)
+
+    def validate_public(self):
+        """Check that the public key can be loaded."""
+        try:
+            ed25519.Ed25519PublicKey.from_public_bytes(
+                    self.get_public_key_bytearray())
+        except ValueError:
+            return False
+        return True
+
+    def get_public_bytes(self):
+        return self._get_public().public_bytes(
+                encoding=serialization.Encoding.PEM,
+                format=serialization.PublicFormat.SubjectPublicKeyInfo)
+
+    def export_private(self, path, passwd=None):
+        self._unsupported('export_private')
+
+    def export_public(self, path):
+        """Write the public key to the given file."""
+        with open(path, 'wb') as f:
+            f.write(self.get_public_bytes())
+
+    def sign_prehashed(self, hash):
+        self._unsupported('sign_prehashed')
+
+class Ed25519(Ed25519Public):
+    """
+    Wrapper around an ED25519 private key.
+    """
+
+    def __init__(self, key):
+        """key should be an instance of Ed25519PrivateKey"""
+        self.key = key
+
+    @staticmethod
+    def generate():
+        return Ed25519(ed25519.Ed25519PrivateKey.generate())
+
+    def _get_public(self):
+        return self.key.public_key()
+
+    def get_private_key_size(self):
+        return 32
+
+    def get_private_key_bytearray(self):
+        return self.key.private_bytes(
+                encoding=serialization.Encoding.Raw,
+                format=serialization.PrivateFormat.Raw,
+                encryption_algorithm=serialization.NoEncryption())
+
+    def export_private(self, path, passwd=None):
+        """Write the private key to the given file, protecting it with the optional password."""
+        if passwd is None:
+            enc = serialization.NoEncryption()
+        else:
+            enc = serialization.BestAvailableEncryption(passwd)
+        pem = self.key.private_bytes(
+                encoding=serialization.Encoding.PEM,
+                format=serialization.PrivateFormat.PKCS8,
+                encryption_algorithm=enc)
+        with open(path, 'wb') as f:
+            f.write(pem)
+
+    def sign_prehashed(self, hash):
+        """The ed25519 signature is calculated over the hash."""
+        return self.key.sign(hash)
@@ -0,0 +1,112 @@
+"""
+Image compression: lz4 type sequences that are split at sector boundaries
+"""
+
+import struct
+
+MIN_MATCH = 4
+MAX_DIST = 0xffff
+HASH_CHAIN = 32
+# A base match (delta images) has a 4 byte base offset after the offset 0
+BASE_COST = 4
+
+def _add_len(out, length):
+    length -= 15
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+def _sequence(out, literals, mlen = 0, dist = 0, boff = None):
+    """Add a sequence, a sequence without match ends a sector. A match with
+    dist 0 is copied from offset boff of the base image."""
+    lit = len(literals)
+    token = min(lit, 15) << 4
+    if mlen:
+        token |= min(mlen - MIN_MATCH, 15)
+    out.append(token)
+    if lit >= 15:
+        _add_len(out, lit)
+    out += literals
+    if mlen:
+        out += bytes([dist & 0xff, dist >> 8])
+        if boff is not None:
+            out += struct.pack('<I', boff)
+        if mlen - MIN_MATCH >= 15:
+            _add_len(out, mlen - MIN_MATCH)
+
+def _index(data):
+    """Positions of each MIN_MATCH byte sequence in data"""
+    chains = {}
+    for pos in range(len(data) - MIN_MATCH + 1):
+        chains.setdefault(bytes(data[pos:pos + MIN_MATCH]), []).append(pos)
+    return chains
+
+def compress(data, sectors, base = b''):
+    """Compress data, sectors is a list of (start, end) positions in data.
+
+    Returns the stream and the stream offset where each sector starts. No
+    sequence crosses a sector end, matches can refer to all earlier data and
+    to the base image (delta images).
+    """
+    out = bytearray()
+    restarts = []
+    chains = {}
+    base_chains = _index(base)
+    shift = 0
+
+    def insert(pos):
+        key = bytes(data[pos:pos + MIN_MATCH])
+        chains.setdefault(key, []).append(pos)
+
+    def base_match(pos, end):
+        """Longest match in base, tries the last used shift first"""
+        best_len, best_off = 0, 0
+        key = bytes(data[pos:pos + MIN_MATCH])
+        cands = base_chains.get(key, [])[-HASH_CHAIN:]
+        for cand in [pos + shift] + cands:
+            if cand < 0 or bytes(base[cand:cand + MIN_MATCH]) != key:
+                continue
+            length = MIN_MATCH
+            while (pos + length < end and cand + length < len(base) and
+                   base[cand + length] == data[pos + length]):
+                length += 1
+            if length > best_len:
+                best_len, best_off = length, cand
+        return best_len, best_off
+
+    for start, end in sectors:
+        restarts.append(len(out))
+        pos = start
+        lit_start = start
+        while pos < end:
+            best_len, best_dist = 0, 0
+            if pos + MIN_MATCH <= end:
+                key = bytes(data[pos:pos + MIN_MATCH])
+                for cand in reversed(chains.get(key, [])[-HASH_CHAIN:]):
+                    if pos - cand > MAX_DIST:
+                        break
+                    length = MIN_MATCH
+                    while (pos + length < end and
+                           data[cand + length] == data[pos + length]):
+                        length += 1
+                    if length > best_len:
+                        best_len, best_dist = length, pos - cand
+            boff = None
+            if base_chains and pos + MIN_MATCH <= end:
+                blen, off = base_match(pos, end)
+                if blen > best_len + BASE_COST:
+                    best_len, best_dist, boff = blen, 0, off
+                    shift = off - pos
+            if best_len >= MIN_MATCH:
+                _sequence(out, data[lit_start:pos], best_len, best_dist, boff)
+                for p in range(pos, pos + best_len):
+                    insert(p)
+                pos += best_len
+                lit_start = pos
+            else:
+                insert(pos)
+                pos += 1
+        if lit_start < end:
+            _sequence(out, data[lit_start:end])
+    return bytes(out), restarts
@@ -24,8 +24,12 @@ from imgtool.version import decode_version
 def gen_ec_p256(keyfile, passwd):
     keys.EC256P1.generate().export_private(keyfile, passwd=passwd)
 
+def gen_ed25519(keyfile, passwd):
+    keys.Ed25519.generate().export_private(keyfile, passwd=passwd)
+
 keygens = {
     'ec-p256': gen_ec_p256,
+    'ed25519': gen_ed25519,
 }
 
 def load_key(keyfile):
@@ -65,6 +69,17 @@ def genkey(type, key, password):
 def geninclude(rootpubkey, bootprikey):
     bootkey = load_key(bootprikey)
     if bootkey is not None:
+        if bootkey.shortname() != 'ec256':
+            raise click.ClickException("The boot key must be a ec-p256 key")
+        # the bootloader does not validate the root keys, check them here
+        rootkeys = []
+        for value in [s.strip() for s in rootpubkey.split(',')]:
+            rootkey = load_key(value)
+            if rootkey is None or not rootkey.validate_public():
+                raise click.ClickException(
+                        "Invalid root public key {}".format(value))
+            rootkeys.append(rootkey)
+
         label = bootkey.shortname()
         print("/* Autogenerated by imgtool.py, do not edit. */")
         print("const unsigned char {}_boot_pri_key[] = {{".format(label), end = '')
@@ -74,20 +89,24 @@ def geninclude(rootpubkey, bootprikey):
         print(bootkey.get_private_key_size(), end = '')
         print(";\n")
 
-        rootlist = [s.strip() for s in rootpubkey.split(',')]
-        rootkeylen = 0
-        print("const unsigned char {}_root_pub_key[] = {{".format(label), end = '')
-        for i, value in enumerate(rootlist):
-            rootkey = load_key(value)
-            if rootkey is not None:
+        # root keys are grouped per key type, ed25519 root keys are optional
+        for keytype in ['ec256', 'ed25519']:
+            typekeys = [k for k in rootkeys if k.shortname() == keytype]
+            if keytype != label and len(typekeys) == 0:
+                continue
+            rootkeylen = 0
+            print("const unsigned char {}_root_pub_key[] = {{".format(keytype), end = '')
+            for rootkey in typekeys:
                 rootkeylen = rootkeylen + rootkey.get_public_key_size()
                 rootkey.emit_public()
-        print("\n};")
-        print("const unsigned int {}_root_pub_key_len = ".format(label), end = '')
-        print(rootkeylen, end= '')
-        print(";\n")
+            print("\n};")
+            print("const unsigned int {}_root_pub_key_len = ".format(keytype), end = '')
+            print(rootkeylen, end= '')
+            print(";\n")
 
 def validate_version(ctx, param, value):
+    if value is None:
+        return value
     try:
         decode_version(value)
         return value
@@ -101,6 +120,21 @@ def validate_image_offset(ctx, param, value):
             "Minimum value for -io/--image-offset is {}".format(min_io))
     return value
 
+def parse_segments(ctx, param, value):
+    segments = []
+    for seg in value:
+        fields = seg.split(',')
+        if len(fields) == 3:
+            fields.append('load')
+        try:
+            offset, size, address = (int(f, 0) for f in fields[:3])
+        except ValueError:
+            raise click.BadParameter("{} is not a valid segment".format(seg))
+        if len(fields) != 4 or fields[3] not in image.SEG_FLAGS:
+            raise click.BadParameter("{} is not a valid segment".format(seg))
+        segments.append((offset, size, address, fields[3]))
+    return segments
+
 class BasedIntParamType(click.ParamType):
     name = 'integer'
 
@@ -132,13 +166,35 @@ class BasedIntParamType(click.ParamType):
               help = 'Sign image using the provided sign key')
 @click.option('-ek','--encrkey', metavar = 'filename',
               help = 'Encrypt image using the provided encrypt key')
+@click.option('-ph', '--plain-hash', is_flag = True, default = False,
+              help = 'Add the hash of the unencrypted image')
+@click.option('-sh', '--sector-hash', type = BasedIntParamType(),
+              metavar = 'sector size',
+              help = 'Add a hash table of sectors with the given size')
+@click.option('-ht', '--hash-type', type = click.Choice(['sha256', 'blake2s']),
+              default = 'sha256', help = 'Hash type used for the image hashes')
+@click.option('-ct', '--cipher',
+              type = click.Choice(['aes128-ctr', 'chacha20']),
+              default = 'aes128-ctr', help = 'Cipher used to encrypt the image')
+@click.option('-cp', '--compress', type = BasedIntParamType(),
+              metavar = 'sector size',
+              help = 'Compress the image, it is expanded in the swap to slot 0')
+@click.option('-db', '--delta-base', metavar = 'filename',
+              help = 'Create a delta to this base image (unsigned input file)')
+@click.option('-dv', '--delta-version', callback = validate_version,
+              help = 'Version of the base image')
+@click.option('-sg', '--segment', multiple = True, callback = parse_segments,
+              metavar = 'offset,size,address[,load|zero|list]',
+              help = 'Add a segment that is placed in RAM by the bootloader')
 @click.option('-tst', '--test-image', help = 'generate test image as c file')
 @click.command(help='''Create a image for use with ZEPboot\n
                INFILE and OUTFILE are parsed as Intel HEX if the params have
                .hex extension, otherwise binary format is used''')
 
 def create(image_offset, align, slot_address, version, slot_size,
-           endian, signkey, encrkey, test_image, infile, outfile):
+           endian, signkey, encrkey, plain_hash, sector_hash, hash_type,
+           cipher, compress, delta_base, delta_version, segment, test_image,
+           infile, outfile):
     signkey = load_key(signkey)
     if signkey is not None:
         encrkey = load_key(encrkey) if encrkey else None
@@ -146,8 +202,24 @@ def create(image_offset, align, slot_address, version, slot_size,
                           align = int(align), slot_address = slot_address,
                           version = decode_version(version), endian = endian)
         img.load(infile)
-        img.create(signkey, encrkey)
+        base = None
+        if delta_base is not None:
+            if delta_version is None:
+                raise click.UsageError("Delta images require -dv")
+            base_img = image.Image(image_offset = image_offset,
+                                   slot_address = slot_address,
+                                   endian = endian)
+            base_img.load(delta_base)
+            base = bytes(base_img.payload[image_offset:])
+            delta_version = decode_version(delta_version)
+        img.create(signkey, encrkey, plain_hash, sector_hash, hash_type,
+                   cipher, compress, base, delta_version, segment)
         img.save(outfile)
+        if (img.stream_offset is not None and
+            not outfile.lower().endswith('.' + image.INTEL_HEX_EXT)):
+            print("Compressed image: write 0x{:x} bytes from the start and "
+                  "the rest at slot offset 0x{:x}".format(
+                  img.image_offset, img.stream_offset))
         if test_image is not None:
             print("const unsigned char {}[{}] = {{".format(test_image, len(img.payload)),end = '')
             for count, b in enumerate(img.payload):
@@ -0,0 +1,81 @@
+# Copyright 2019 LaczenJMS
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+imgtool image tests, run from the scripts directory with:
+python3 -m unittest discover -s tests
+"""
+
+import os
+import sys
+import tempfile
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+import imgtool.keys as keys
+from imgtool import image
+
+IMAGE_OFFSET = 0x200
+SLOT_ADDRESS = 0x11000
+SLOT_SIZE = 0x10000
+SECTOR_SIZE = 0x400
+
+class CompressedImageTest(unittest.TestCase):
+
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.signkey = keys.EC256P1.generate()
+        # 16 kB of compressible data
+        self.infile = os.path.join(self.dir.name, 'in.bin')
+        with open(self.infile, 'wb') as f:
+            f.write(bytes(range(256)) * 64)
+
+    def tearDown(self):
+        self.dir.cleanup()
+
+    def create(self, name, compress_size = None):
+        img = image.Image(image_offset = IMAGE_OFFSET, slot_size = SLOT_SIZE,
+                          align = 4, slot_address = SLOT_ADDRESS)
+        img.load(self.infile)
+        img.create(self.signkey, None, compress_size = compress_size)
+        path = os.path.join(self.dir.name, name)
+        img.save(path)
+        return img, path
+
+    def test_compressed_bin_size(self):
+        img, path = self.create('cmp.bin', SECTOR_SIZE)
+        _, plain = self.create('plain.bin')
+        stream = len(img.payload) - img.stream_offset
+        self.assertEqual(os.path.getsize(path), IMAGE_OFFSET + stream)
+        self.assertLess(os.path.getsize(path), os.path.getsize(plain) // 4)
+
+        # the saved parts rebuild the image in the slot
+        with open(path, 'rb') as f:
+            data = f.read()
+        self.assertEqual(data[:IMAGE_OFFSET], img.payload[:IMAGE_OFFSET])
+        self.assertEqual(data[IMAGE_OFFSET:],
+                         img.payload[img.stream_offset:])
+
+    def test_compressed_parts(self):
+        img, _ = self.create('cmp.bin', SECTOR_SIZE)
+        parts = img.parts()
+        self.assertEqual([offset for offset, data in parts],
+                         [0, img.stream_offset])
+        self.assertGreater(img.stream_offset, IMAGE_OFFSET)
+        self.assertEqual(sum(len(data) for offset, data in parts),
+                         IMAGE_OFFSET + len(img.payload) - img.stream_offset)
+
+if __name__ == '__main__':
+    unittest.main()
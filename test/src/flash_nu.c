@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2019 Laczen
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <flash.h>
+#include <init.h>
+#include "flash_nu.h"
+
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+
+/* The pages before, between and after the slots are SECTOR_SIZE */
+static const struct flash_pages_layout flash_nu_layout[] = {
+	{DT_FLASH_AREA_IMAGE_0_OFFSET / SECTOR_SIZE, SECTOR_SIZE},
+	{1, SECTOR_SIZE},
+	{1, 4 * SECTOR_SIZE},
+	{FLASH_NU_LARGE_CNT, 8 * SECTOR_SIZE},
+	{(DT_FLASH_AREA_IMAGE_1_OFFSET - DT_FLASH_AREA_IMAGE_0_OFFSET -
+	  FLASH_NU_SLOT_SIZE) / SECTOR_SIZE, SECTOR_SIZE},
+	{1, SECTOR_SIZE},
+	{1, 4 * SECTOR_SIZE},
+	{FLASH_NU_LARGE_CNT, 8 * SECTOR_SIZE},
+	{(DT_FLASH_AREA_IMAGE_1_SIZE - FLASH_NU_SLOT_SIZE) / SECTOR_SIZE,
+	 SECTOR_SIZE},
+};
+
+static struct device *flash_nu_dev;
+
+static int flash_nu_read(struct device *dev, off_t offset, void *data,
+			 size_t len)
+{
+	return flash_read(flash_nu_dev, offset, data, len);
+}
+
+static int flash_nu_write(struct device *dev, off_t offset, const void *data,
+			  size_t len)
+{
+	return flash_write(flash_nu_dev, offset, data, len);
+}
+
+/* Only complete pages of the layout can be erased */
+static int flash_nu_erase(struct device *dev, off_t offset, size_t size)
+{
+	struct flash_pages_info first, last;
+
+	if ((!size) ||
+	    flash_get_page_info_by_offs(dev, offset, &first) ||
+	    flash_get_page_info_by_offs(dev, offset + size - 1, &last) ||
+	    (first.start_offset != offset) ||
+	    ((last.start_offset + last.size) != (offset + size))) {
+		return -EINVAL;
+	}
+	return flash_erase(flash_nu_dev, offset, size);
+}
+
+static int flash_nu_write_protection(struct device *dev, bool enable)
+{
+	return flash_write_protection_set(flash_nu_dev, enable);
+}
+
+static void flash_nu_page_layout(struct device *dev,
+				 const struct flash_pages_layout **layout,
+				 size_t *layout_size)
+{
+	*layout = flash_nu_layout;
+	*layout_size = ARRAY_SIZE(flash_nu_layout);
+}
+
+static const struct flash_driver_api flash_nu_api = {
+	.read = flash_nu_read,
+	.write = flash_nu_write,
+	.erase = flash_nu_erase,
+	.write_protection = flash_nu_write_protection,
+	.page_layout = flash_nu_page_layout,
+	.write_block_size = 4, /* write block of the test flash devices */
+};
+
+static int flash_nu_init(struct device *dev)
+{
+	flash_nu_dev = device_get_binding(DT_FLASH_AREA_0_DEV);
+	if (!flash_nu_dev) {
+		return -ENXIO;
+	}
+	return 0;
+}
+
+DEVICE_AND_API_INIT(flash_nu, FLASH_NU_DEV, flash_nu_init, NULL, NULL,
+		    APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,
+		    &flash_nu_api);
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * Test flash device with a non uniform page layout: the slots have the
+ * 16/64/128 KiB sectors of a STM32F4 scaled to SECTOR_SIZE (a SECTOR_SIZE
+ * page, a 4 * SECTOR_SIZE page and 8 * SECTOR_SIZE pages up to the slot end).
+ * The device uses the flash of DT_FLASH_AREA_0_DEV, slot_map[1] describes the
+ * slot area with the test partitions on this device.
+ *
+ * Copyright (c) 2019 Laczen
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef H_FLASH_NU_
+#define H_FLASH_NU_
+
+#include "../../zepboot/include/zb_flash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_NU_DEV "FLASH_NU"
+
+/* number of 8 * SECTOR_SIZE pages in each slot */
+#define FLASH_NU_LARGE_CNT \
+	((MIN(DT_FLASH_AREA_IMAGE_0_SIZE, DT_FLASH_AREA_IMAGE_1_SIZE) - \
+	  5 * SECTOR_SIZE) / (8 * SECTOR_SIZE))
+
+#define FLASH_NU_SLOT_SIZE \
+	(5 * SECTOR_SIZE + FLASH_NU_LARGE_CNT * 8 * SECTOR_SIZE)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
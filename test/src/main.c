@@ -14,6 +14,8 @@ extern void test_zb_tlv(void);
 extern void test_zb_aes(void);
 extern void test_zb_image(void);
 extern void test_zb_move(void);
+extern void test_zb_ret(void);
+extern void test_zb_handoff(void);
 
 void test_main(void)
 {
@@ -23,4 +25,6 @@ void test_main(void)
 	test_zb_aes();
 	test_zb_image();
 	test_zb_move();
+	test_zb_ret();
+	test_zb_handoff();
 }
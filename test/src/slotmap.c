@@ -15,6 +15,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include "../../zepboot/include/zb_flash.h"
+#include "flash_nu.h"
 
 const struct slt_area slot_map[] = {
 	{.slt0_offset = DT_FLASH_AREA_IMAGE_0_OFFSET,
@@ -26,7 +27,26 @@ const struct slt_area slot_map[] = {
 	 .slt0_devname = DT_FLASH_AREA_0_DEV,
 	 .slt1_devname = DT_FLASH_AREA_0_DEV,
 	 .swpstat_devname = DT_FLASH_AREA_0_DEV,
+	 .scratch_cnt = 0,
+	 .prio = 0,
+	 .swp_budget_ms = 0,
 	},
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	/* the same partitions on a device with non uniform pages */
+	{.slt0_offset = DT_FLASH_AREA_IMAGE_0_OFFSET,
+	 .slt1_offset = DT_FLASH_AREA_IMAGE_1_OFFSET,
+	 .swpstat_offset = DT_FLASH_AREA_IMAGE_SCRATCH_OFFSET,
+	 .slt0_size = FLASH_NU_SLOT_SIZE,
+	 .slt1_size = FLASH_NU_SLOT_SIZE,
+	 .swpstat_size = DT_FLASH_AREA_IMAGE_SCRATCH_SIZE,
+	 .slt0_devname = FLASH_NU_DEV,
+	 .slt1_devname = FLASH_NU_DEV,
+	 .swpstat_devname = DT_FLASH_AREA_0_DEV,
+	 .scratch_cnt = 0,
+	 .prio = 0,
+	 .swp_budget_ms = 0,
+	},
+#endif
 };
 
 const unsigned int slot_map_cnt = sizeof(slot_map)/sizeof(slot_map[0]);
@@ -12,6 +12,7 @@
 #include "../../zepboot/include/zb_tlv.h"
 #include "../../zepboot/include/zb_image.h"
 #include "../../zepboot/include/zb_aes.h"
+#include "../../zepboot/include/zb_chacha.h"
 #include "../../zepboot/include/zb_move.h"
 
 
@@ -22,6 +23,10 @@ extern u8_t test_msg[];
 extern u8_t ec256_boot_pri_key[];
 u8_t enc_test_msg[HASH_BYTES];
 u8_t dec_test_msg[HASH_BYTES];
+extern u8_t test_chacha20_rfc_key[];
+extern u8_t test_chacha20_rfc_nonce[];
+extern u8_t test_chacha20_rfc_msg[];
+extern u8_t test_chacha20_rfc_enc[];
 
 /**
  * @brief Test the aes enc routine
@@ -59,11 +64,41 @@ void test_zb_aes_dec(void)
 
 }
 
+/**
+ * @brief Test the chacha20 routines, including starting at random offsets
+ */
+void test_zb_chacha20(void)
+{
+	int err;
+	size_t i, len = 114;
+	u8_t buf[114];
+	struct zb_chacha20_ctx ctx;
+
+	/* RFC 7539 vector, the initial block counter is 1 */
+	memcpy(buf, test_chacha20_rfc_msg, len);
+	zb_chacha20_init(&ctx, test_chacha20_rfc_key, test_chacha20_rfc_nonce);
+	zb_chacha20_seek(&ctx, CHACHA20_BLOCK_BYTES);
+	zb_chacha20_xor(&ctx, buf, 10);
+	zb_chacha20_xor(&ctx, buf + 10, len - 10);
+	err = memcmp(buf, test_chacha20_rfc_enc, len);
+	zassert_true(err == 0,  "CHACHA20 wrong encrypt data");
+
+	/* decrypt from inside the stream, within and across blocks */
+	for (i = 0; i < len; i += 37) {
+		memcpy(buf, test_chacha20_rfc_enc, len);
+		zb_chacha20_seek(&ctx, CHACHA20_BLOCK_BYTES + i);
+		zb_chacha20_xor(&ctx, buf + i, len - i);
+		err = memcmp(buf + i, test_chacha20_rfc_msg + i, len - i);
+		zassert_true(err == 0,  "CHACHA20 wrong decrypt at %d", (int)i);
+	}
+}
+
 void test_zb_aes(void)
 {
 	ztest_test_suite(test_zb_aes,
 			 ztest_unit_test(test_zb_aes_enc),
-			 ztest_unit_test(test_zb_aes_dec)
+			 ztest_unit_test(test_zb_aes_dec),
+			 ztest_unit_test(test_zb_chacha20)
 			);
 
 	ztest_run_test_suite(test_zb_aes);
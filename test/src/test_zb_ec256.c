@@ -10,6 +10,7 @@
 #include <flash.h>
 #include "../../zepboot/include/zb_flash.h"
 #include "../../zepboot/include/zb_ec256.h"
+#include "../../zepboot/include/zb_ed25519.h"
 
 #include <logging/log.h>
 LOG_MODULE_REGISTER(test_zb_ec256);
@@ -48,6 +49,73 @@ void test_zb_hash_flash(void)
 	zassert_true(err == 0, "Hash differs");
 }
 
+/**
+ * @brief Test BLAKE2s hash calculation
+ */
+void test_zb_hash_blake2s(void)
+{
+	int err, cnt;
+	struct zb_slt_area area;
+	struct zb_hash_ctx ctx;
+	u8_t hash[HASH_BYTES], data[200];
+	const u8_t abc_hash[HASH_BYTES] = {
+		0x50, 0x8c, 0x5e, 0x8c, 0x32, 0x7c, 0x14, 0xe2,
+		0xe1, 0xa7, 0x2b, 0xa3, 0x4e, 0xeb, 0x45, 0x2f,
+		0x37, 0x45, 0x8b, 0x20, 0x9e, 0xd6, 0x3a, 0x29,
+		0x4d, 0x99, 0x9b, 0x4c, 0x86, 0x67, 0x59, 0x82
+	};
+	const u8_t data_hash[HASH_BYTES] = {
+		0x6d, 0x24, 0x4e, 0x1a, 0x06, 0xce, 0x4e, 0xf5,
+		0x78, 0xdd, 0x0f, 0x63, 0xaf, 0xf0, 0x93, 0x67,
+		0x06, 0x73, 0x51, 0x19, 0xca, 0x9c, 0x8d, 0x22,
+		0xd8, 0x6c, 0x80, 0x14, 0x14, 0xab, 0x97, 0x41
+	};
+	const u8_t msg_hash[HASH_BYTES] = {
+		0xc4, 0x38, 0x02, 0xa7, 0x13, 0x01, 0x3e, 0x50,
+		0x1d, 0x2d, 0x6a, 0xd2, 0x44, 0xb2, 0xf4, 0xc3,
+		0xa5, 0x19, 0xc9, 0x03, 0xc6, 0x27, 0x82, 0x03,
+		0x7c, 0x8f, 0x4c, 0x38, 0x96, 0x54, 0x97, 0x7b
+	};
+
+	err = zb_hash_init(&ctx, HASH_TYPE_BLAKE2S);
+	zassert_true(err == 0, "Hash init failed: [err %d]", err);
+	err = zb_hash_update(&ctx, (const u8_t *)"abc", 3);
+	zassert_true(err == 0, "Hash update failed: [err %d]", err);
+	err = zb_hash_final(hash, &ctx);
+	zassert_true(err == 0, "Hash final failed: [err %d]", err);
+	err = memcmp(hash, abc_hash, HASH_BYTES);
+	zassert_true(err == 0, "Hash differs");
+
+	/* multiple blocks in unaligned parts */
+	for (cnt = 0; cnt < sizeof(data); cnt++) {
+		data[cnt] = cnt;
+	}
+	(void)zb_hash_init(&ctx, HASH_TYPE_BLAKE2S);
+	(void)zb_hash_update(&ctx, data, 1);
+	(void)zb_hash_update(&ctx, &data[1], 64);
+	(void)zb_hash_update(&ctx, &data[65], sizeof(data) - 65);
+	(void)zb_hash_final(hash, &ctx);
+	err = memcmp(hash, data_hash, HASH_BYTES);
+	zassert_true(err == 0, "Hash differs");
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0,  "Unable to get slotarea info: [err %d]", err);
+	err = zb_flash_erase(area.slt0_fldev, area.slt0_offset, area.slt0_size);
+	zassert_true(err == 0,  "Unable to erase image 0 area: [err %d]", err);
+	err = zb_flash_write(area.slt0_fldev, area.slt0_offset, test_msg,
+			     HASH_BYTES);
+	zassert_true(err == 0,  "Unable to write test message: [err %d]", err);
+
+	err = zb_hash_flash_type(hash, HASH_TYPE_BLAKE2S, area.slt0_fldev,
+				 area.slt0_offset, HASH_BYTES);
+	zassert_true(err == 0, "Hash calculation failed: [err %d]", err);
+	err = memcmp(hash, msg_hash, HASH_BYTES);
+	zassert_true(err == 0, "Hash differs");
+
+	err = zb_hash_init(&ctx, 0x7f);
+	zassert_false(err == 0, "Unknown hash type accepted");
+}
+
 extern u8_t test_signature[];
 
 /**
@@ -72,6 +140,96 @@ void test_zb_sign_verify(void)
 
 }
 
+extern const unsigned char ec256_root_pub_key[];
+extern const unsigned int ec256_root_pub_key_len;
+
+/**
+ * @brief Test signature verification using a key id
+ */
+void test_zb_sign_verify_id(void)
+{
+	int err, cnt, valid = 0;
+	u8_t key_id[KEY_ID_BYTES];
+
+	/* only the root key that generated the signature is valid */
+	for (cnt = 0; cnt < ec256_root_pub_key_len; cnt += PUBLIC_KEY_BYTES) {
+		err = zb_key_id(key_id, &ec256_root_pub_key[cnt],
+				PUBLIC_KEY_BYTES);
+		zassert_true(err == 0, "Failed to get key id: [err %d]", err);
+		if (!zb_sign_verify_id(test_msg_hash, test_signature,
+				       key_id)) {
+			valid++;
+		}
+	}
+	zassert_true(valid == 1, "Wrong number of valid keys: [cnt %d]", valid);
+
+	/* unknown key id */
+	key_id[0] ^= 0xff;
+	err = zb_sign_verify_id(test_msg_hash, test_signature, key_id);
+	zassert_false(err == 0, "Unknown key id generates valid signature");
+
+	/* no key id: all root keys are tried */
+	err = zb_sign_verify_id(test_msg_hash, test_signature, NULL);
+	zassert_true(err == 0, "Signature validation failed: [err %d]", err);
+}
+
+extern u8_t test_ed25519_rfc_msg[];
+extern u8_t test_ed25519_rfc_pub_key[];
+extern u8_t test_ed25519_rfc_signature[];
+extern u8_t test_ed25519_signature[];
+
+/**
+ * @brief Test ed25519 signature verification
+ */
+void test_zb_ed25519_verify(void)
+{
+	int err, cnt, carry;
+	u8_t sig[ED25519_SIGNATURE_BYTES], key_id[KEY_ID_BYTES];
+	const u8_t l[32] = {
+		0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+		0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+	};
+
+	err = zb_ed25519_verify(test_ed25519_rfc_msg, 2,
+				test_ed25519_rfc_signature,
+				test_ed25519_rfc_pub_key);
+	zassert_true(err == 0, "Signature validation failed: [err %d]", err);
+
+	err = zb_ed25519_verify(test_ed25519_rfc_msg, 1,
+				test_ed25519_rfc_signature,
+				test_ed25519_rfc_pub_key);
+	zassert_false(err == 0, "Invalid message generates valid signature");
+
+	/* S + L is not accepted (signature malleability) */
+	memcpy(sig, test_ed25519_rfc_signature, ED25519_SIGNATURE_BYTES);
+	carry = 0;
+	for (cnt = 0; cnt < 32; cnt++) {
+		carry += sig[32 + cnt] + l[cnt];
+		sig[32 + cnt] = carry & 0xff;
+		carry >>= 8;
+	}
+	err = zb_ed25519_verify(test_ed25519_rfc_msg, 2, sig,
+				test_ed25519_rfc_pub_key);
+	zassert_false(err == 0, "Non canonical signature is valid");
+
+	/* root key verification */
+	err = zb_ed25519_sign_verify(test_msg_hash, test_ed25519_signature,
+				     NULL);
+	zassert_true(err == 0, "Signature validation failed: [err %d]", err);
+
+	err = zb_key_id(key_id, test_ed25519_rfc_pub_key,
+			ED25519_PUBLIC_KEY_BYTES);
+	zassert_true(err == 0, "Failed to get key id: [err %d]", err);
+	err = zb_ed25519_sign_verify(test_msg_hash, test_ed25519_signature,
+				     key_id);
+	zassert_false(err == 0, "Unknown key id generates valid signature");
+
+	err = zb_ed25519_sign_verify(test_msg_hash, test_signature, NULL);
+	zassert_false(err == 0, "Invalid signature is valid");
+}
+
 extern u8_t test_enc_pub_key[];
 extern u8_t test_enc_key[];
 
@@ -134,7 +292,10 @@ void test_zb_ec256(void)
 {
 	ztest_test_suite(test_zb_ec256,
 			 ztest_unit_test(test_zb_hash_flash),
+			 ztest_unit_test(test_zb_hash_blake2s),
 			 ztest_unit_test(test_zb_sign_verify),
+			 ztest_unit_test(test_zb_sign_verify_id),
+			 ztest_unit_test(test_zb_ed25519_verify),
 			 ztest_unit_test(test_zb_get_encr_key),
 			 ztest_unit_test(test_zb_crc32)
 	);
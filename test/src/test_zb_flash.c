@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <flash.h>
 #include "../../zepboot/include/zb_flash.h"
+#include "../../zepboot/include/zb_move.h"
 
 #include <logging/log.h>
 LOG_MODULE_REGISTER(test_zb_flash);
@@ -32,6 +33,52 @@ void test_zb_get_area(void)
 	}
 }
 
+/**
+ * @brief Test zb_flash_layout_check()
+ */
+void test_zb_layout(void)
+{
+	int err;
+	struct zb_slt_area area;
+	size_t size;
+	off_t off;
+	u8_t sect;
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0,  "Unable to get slotarea info: [err %d]", err);
+
+	err = zb_flash_layout_check(area.slt0_fldev, area.slt0_offset,
+				    4 * SECTOR_SIZE, 2 * SECTOR_SIZE);
+	zassert_true(err == 0,  "Layout check failed: [err %d]", err);
+	err = zb_flash_layout_check(area.slt0_fldev, area.slt0_offset,
+				    3 * SECTOR_SIZE, 2 * SECTOR_SIZE);
+	zassert_true(err == -EINVAL,  "Bad size accepted: [err %d]", err);
+
+	/* the test flash has uniform sectors */
+	zassert_true(zb_sector_uniform(&area), "Sectors not uniform");
+	for (sect = 0; sect < 4; sect++) {
+		off = zb_sector_offset(&area, sect, &size);
+		zassert_true((off == sect * SECTOR_SIZE) &&
+			     (size == SECTOR_SIZE),
+			     "Bad sector: [sect %d]", sect);
+	}
+	zassert_true(zb_sector_last(&area, 0) == SECTOR_SIZE,
+		     "Bad last sector");
+
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	/* a erase page can't be split over two units */
+	err = zb_flash_layout_check(area.slt0_fldev, area.slt0_offset,
+				    DT_FLASH_ERASE_BLOCK_SIZE,
+				    DT_FLASH_ERASE_BLOCK_SIZE / 2);
+	zassert_true(err == -EINVAL,  "Bad unit accepted: [err %d]", err);
+	err = zb_flash_layout_check(area.slt0_fldev,
+				    area.slt0_offset + DT_FLASH_ERASE_BLOCK_SIZE / 2,
+				    DT_FLASH_ERASE_BLOCK_SIZE,
+				    DT_FLASH_ERASE_BLOCK_SIZE);
+	zassert_true(err == -EINVAL,  "Bad offset accepted: [err %d]", err);
+#endif
+}
+
 /**
  * @brief Test read and write of zb commands
  */
@@ -100,6 +147,18 @@ void test_zb_prm(void)
 	prm.slt1_crc32 = 0x0;
 	prm.slt1_ver = 0x0;
 	prm.sec_ld_address = 0x0;
+	prm.prm_ver = ZB_PRM_VERSION;
+	prm.slt0_start = 0x0;
+	prm.slt0_size = 0x0;
+	prm.slt0_vt_address = 0x0;
+	prm.slt1_start = 0x0;
+	prm.slt1_size = 0x0;
+	prm.slt1_vt_address = 0x0;
+	prm.slt0_flags = ZB_PRM_FLAG_ENC;
+	prm.slt1_flags = 0x0;
+	prm.slt0_seg_offset = 0x0;
+	prm.slt1_seg_offset = 0x0;
+	prm.scr_start = 0x2;
 
 	err = zb_prm_write(&area, &prm);
 	zassert_true(err == 0,  "Unable to write prm: [err %d]", err);
@@ -112,12 +171,83 @@ void test_zb_prm(void)
 
 }
 
+/**
+ * @brief Test read and write of the zb idle record
+ */
+void test_zb_idle(void)
+{
+	int err, cnt;
+	struct zb_slt_area area;
+	struct zb_idle idle;
+	struct zb_cmd cmd;
+
+	cnt = zb_slt_area_cnt();
+	zassert_false(cnt == 0,  "Unable to get slotarea count: [cnt %d]", cnt);
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0,  "Unable to get slotarea info: [err %d]", err);
+
+	err = zb_erase_swpstat(&area);
+	zassert_true(err == 0,  "Unable to erase stat area: [err %d]", err);
+
+	err = zb_erase_slt1end(&area);
+	zassert_true(err == 0,  "Unable to erase slt1end: [err %d]", err);
+
+	err = zb_idle_read(&area, &idle);
+	zassert_true(err == -ENOENT, "Found idle record in empty flash area");
+
+	err = zb_idle_write(&area);
+	zassert_true(err == 0, "Unable to write idle record: [err %d]", err);
+
+	err = zb_idle_read(&area, &idle);
+	zassert_true(err == 0, "Unable to read idle record: [err %d]", err);
+	zassert_true(idle.cnt == 0, "Wrong idle cmd count");
+
+	/* a new command invalidates the idle record */
+	cmd.cmd1 = CMD1_MASK_BT0_REQUEST;
+	cmd.cmd2 = 0x0;
+	cmd.cmd3 = 0x0;
+	err = zb_cmd_write_slt1end(&area, &cmd);
+	zassert_true(err == 0, "Failed to write command");
+
+	err = zb_idle_read(&area, &idle);
+	zassert_true(err == -ENOENT, "Idle record not invalidated");
+
+	/* rewriting requires the swpstat area to be erased */
+	err = zb_idle_write(&area);
+	zassert_true(err == 0, "Unable to write idle record: [err %d]", err);
+
+	err = zb_idle_read(&area, &idle);
+	zassert_true(err == 0, "Unable to read idle record: [err %d]", err);
+	zassert_true(idle.cnt == 1, "Wrong idle cmd count");
+	zassert_true(idle.cmd1 == CMD1_MASK_BT0_REQUEST, "Wrong idle cmd1");
+
+	/* erasing slt1end also invalidates the idle record */
+	err = zb_erase_slt1end(&area);
+	zassert_true(err == 0,  "Unable to erase slt1end: [err %d]", err);
+
+	err = zb_idle_read(&area, &idle);
+	zassert_true(err == -ENOENT, "Idle record not invalidated");
+
+	/* a swap start invalidates the idle record */
+	err = zb_idle_write(&area);
+	zassert_true(err == 0, "Unable to write idle record: [err %d]", err);
+
+	err = zb_erase_swpstat(&area);
+	zassert_true(err == 0,  "Unable to erase stat area: [err %d]", err);
+
+	err = zb_idle_read(&area, &idle);
+	zassert_true(err == -ENOENT, "Idle record not invalidated");
+}
+
 void test_zb_flash(void)
 {
 	ztest_test_suite(test_zb_flash,
 			 ztest_unit_test(test_zb_get_area),
+			 ztest_unit_test(test_zb_layout),
 			 ztest_unit_test(test_zb_cmd),
-			 ztest_unit_test(test_zb_prm)
+			 ztest_unit_test(test_zb_prm),
+			 ztest_unit_test(test_zb_idle)
 			);
 
 	ztest_run_test_suite(test_zb_flash);
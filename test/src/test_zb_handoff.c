@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2019 Laczen
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include "../../zepboot/include/zb_handoff.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(test_zb_handoff);
+
+/**
+ * @brief Test filling and sealing of a handoff record
+ */
+void test_zb_handoff_rw(void)
+{
+	struct zb_handoff ho;
+	zb_img_info info;
+	u32_t crc32;
+
+	memset(&ho, 0, sizeof(ho));
+	memset(&info, 0, sizeof(info));
+	info.hdr_start = 0x11000;
+	info.start = 0x11200;
+	info.end = 0x11400;
+	info.load_address = 0x11200;
+	info.version.major = 1;
+	info.version.minor = 2;
+	info.version.revision = 3;
+	ho.slt = 1;
+	ho.swp_mask = BIT(0);
+
+	zb_handoff_write(&ho, &info);
+	zassert_true(ho.magic == ZB_HANDOFF_MAGIC, "Wrong magic");
+	zassert_true(ho.version == ZB_HANDOFF_VERSION, "Wrong version");
+	zassert_true(ho.img.start == info.start, "Wrong image start");
+	zassert_true(ho.img.end == info.end, "Wrong image end");
+	zassert_true(ho.img.version.minor == 2, "Wrong image version");
+	zassert_true(ho.slt == 1, "Slot modified");
+	zassert_true(ho.swp_mask == BIT(0), "Swap mask modified");
+
+	crc32 = crc32_ieee((const u8_t *)&ho,
+			   offsetof(struct zb_handoff, crc32));
+	zassert_true(ho.crc32 == crc32, "Wrong seal");
+}
+
+void test_zb_handoff(void)
+{
+	ztest_test_suite(test_zb_handoff,
+			 ztest_unit_test(test_zb_handoff_rw)
+			);
+
+	ztest_run_test_suite(test_zb_handoff);
+}
@@ -262,8 +262,10 @@ void test_zb_check_image(void)
 	zassert_true(err == 0,  "Image check failed");
 	zassert_true(slt == 1,  "Wrong slot");
 
+	memset(&prm, 0, sizeof(struct zb_prm));
 	prm.pri_ld_address = area.slt1_offset;
 	prm.slt0_ver = 1;
+	prm.slt1_ver = 1;
 	err = zb_prm_write(&area, &prm);
 	zassert_true(err == 0,  "Unable to write prm area: [err %d]", err);
 
@@ -271,6 +273,82 @@ void test_zb_check_image(void)
 	zassert_false(err == 0,  "Image check failed");
 }
 
+/* Write img to slot 0 with a segment table added */
+static void test_zb_image_seg_write(struct zb_slt_area *area,
+				    const zb_tlv_img_seg *seg, u8_t cnt)
+{
+	int err;
+	u8_t img[1536];
+	u16_t tlva_size;
+	u8_t len = cnt * TLVE_IMAGE_SEG_BYTES;
+
+	memcpy(img, test_image_slt0, sizeof(img));
+	memcpy(&tlva_size, &img[4], sizeof(tlva_size));
+	img[tlva_size] = TLVE_IMAGE_SEG;
+	img[tlva_size + 1] = len;
+	memcpy(&img[tlva_size + 2], seg, len);
+	tlva_size += 2 + len;
+	memcpy(&img[4], &tlva_size, sizeof(tlva_size));
+
+	err = zb_flash_erase(area->slt0_fldev, area->slt0_offset,
+			     area->slt0_size);
+	zassert_true(err == 0,  "Unable to erase image 0 area: [err %d]", err);
+	err = zb_flash_write(area->slt0_fldev, area->slt0_offset, img,
+			     sizeof(img));
+	zassert_true(err == 0,  "Unable to write the image: [err %d]", err);
+}
+
+/**
+ * @brief Test the segment table of a image in slot 0
+ */
+void test_zb_get_image_info_seg(void)
+{
+	int err;
+	struct zb_slt_area area;
+	zb_img_info info;
+	struct zb_prm prm;
+	zb_tlv_img_seg seg[IMG_SEG_MAX + 1] = {
+		{0x100, 0x200, 0x20000000, SEG_FLAG_LOAD},
+		{0x0, 0x4000, 0x20001000, SEG_FLAG_ZERO},
+	};
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0,  "Unable to get slotarea info: [err %d]", err);
+
+	test_zb_image_seg_write(&area, seg, 2);
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	zassert_true(info.is_valid,  "Error loading image info");
+	zassert_true(info.seg_cnt == 2,  "Wrong segment count");
+	err = memcmp(info.seg, seg, 2 * sizeof(zb_tlv_img_seg));
+	zassert_true(err == 0,  "Wrong segment table");
+
+	/* the prm gives the table location, the tlv area is not parsed */
+	prm.prm_ver = ZB_PRM_VERSION;
+	prm.slt0_ver = 0;
+	prm.slt0_start = info.start;
+	prm.slt0_size = info.end - info.start;
+	prm.slt0_vt_address = info.load_address;
+	prm.slt0_flags = ZB_PRM_FLAG_SEG;
+	prm.slt0_seg_offset = info.seg_offset;
+	memset(info.seg, 0, sizeof(info.seg));
+	err = zb_img_get_info_prm(&info, &area, &prm, 0);
+	zassert_true(err == 0,  "Unable to get prm image info: [err %d]", err);
+	zassert_true(info.seg_cnt == 2,  "Wrong prm segment count");
+	err = memcmp(info.seg, seg, 2 * sizeof(zb_tlv_img_seg));
+	zassert_true(err == 0,  "Wrong prm segment table");
+
+	/* segments with image data must be inside the image */
+	seg[0].size = 0x1000;
+	test_zb_image_seg_write(&area, seg, 2);
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	zassert_false(info.is_valid,  "Segment outside image accepted");
+
+	seg[0].size = 0x200;
+	test_zb_image_seg_write(&area, seg, IMG_SEG_MAX + 1);
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	zassert_false(info.is_valid,  "Too many segments accepted");
+}
+
 void test_zb_image(void)
 {
 	ztest_test_suite(test_zb_image,
@@ -278,7 +356,8 @@ void test_zb_image(void)
 			 ztest_unit_test(test_zb_get_image_info_slt0_enc),
 			 ztest_unit_test(test_zb_get_image_info_slt1),
 			 ztest_unit_test(test_zb_get_image_info_slt1_enc),
-			 ztest_unit_test(test_zb_check_image)
+			 ztest_unit_test(test_zb_check_image),
+			 ztest_unit_test(test_zb_get_image_info_seg)
 			);
 
 	ztest_run_test_suite(test_zb_image);
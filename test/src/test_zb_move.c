@@ -12,6 +12,7 @@
 #include "../../zepboot/include/zb_tlv.h"
 #include "../../zepboot/include/zb_image.h"
 #include "../../zepboot/include/zb_move.h"
+#include "../../zepboot/include/zb_predec.h"
 
 
 #include <logging/log.h>
@@ -21,6 +22,9 @@ extern const unsigned char test_image_slt0[1536];
 extern const unsigned char test_image_slt1[1536];
 extern const unsigned char test_image_slt0_enc[1536];
 extern const unsigned char test_image_slt1_enc[1536];
+extern const unsigned char test_image_slt1_sect[1600];
+extern const unsigned char test_image_slt0_cmp[3156];
+extern const unsigned char test_image_slt0_delta[3100];
 
 #define HDR_SIZE 512
 /**
@@ -31,6 +35,9 @@ void test_zb_image_classic_move_clr(void)
 	int err, cnt;
 	struct zb_slt_area area;
 	struct zb_cmd cmd;
+	struct zb_prm prm;
+	zb_img_info info;
+	u32_t crc32, tbl_crc32;
 	u8_t imgheader[HDR_SIZE];
 	u8_t img[1536-HDR_SIZE];
 
@@ -69,6 +76,28 @@ void test_zb_image_classic_move_clr(void)
 	zassert_true(err == 0, "Unable to read moved image");
 	err = memcmp(img, &test_image_slt0[HDR_SIZE], 1536 - HDR_SIZE);
 	zassert_true(err == 0, "Difference detected in image");
+
+	/* the image location is available from prm */
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_get_info_prm(&info, &area, &prm, 0);
+	zassert_true(err == 0, "No image info in prm: [err %d]", err);
+	zassert_true(info.start == area.slt0_offset + HDR_SIZE,
+		     "Wrong img start in prm");
+	zassert_true(info.end == area.slt0_offset + 1536,
+		     "Wrong img end in prm");
+	zassert_true(info.load_address == area.slt0_offset + HDR_SIZE,
+		     "Wrong vector table address in prm");
+
+	/* the per sector crc table matches the image (1 sector) */
+	err = zb_crc_tbl_read(&area, 0, 0, &tbl_crc32);
+	zassert_true(err == 0, "No crc for sector: [err %d]", err);
+	err = zb_img_calc_sect_crc32(&info, 0, &crc32);
+	zassert_true(err == 0, "Sector crc failed: [err %d]", err);
+	zassert_true(crc32 == tbl_crc32, "Sector crc differs");
+	zassert_true(crc32 == prm.slt0_crc32, "Sector crc differs from prm");
+	err = zb_crc_tbl_read(&area, 0, 1, &tbl_crc32);
+	zassert_true(err == -ENOENT, "Crc for sector outside image");
 }
 
 /**
@@ -79,8 +108,12 @@ void test_zb_image_classic_move_enc(void)
 	int err, cnt;
 	struct zb_slt_area area;
 	struct zb_cmd cmd;
+	struct zb_prm prm;
+	zb_img_info info;
+	u32_t crc32, tbl_crc32;
 	u8_t imgheader[HDR_SIZE];
 	u8_t img[1536-HDR_SIZE];
+	u8_t slt;
 
 	cnt = zb_slt_area_cnt();
 	zassert_false(cnt == 0, "Unable to get slotarea count: [cnt %d]", cnt);
@@ -118,6 +151,23 @@ void test_zb_image_classic_move_enc(void)
 	/* test_image_slt0 contains unencrypted test_image_slt0_enc */
 	err = memcmp(img, &test_image_slt0[HDR_SIZE], 1536 - HDR_SIZE);
 	zassert_true(err == 0, "Difference detected in image");
+
+	/* the crc32 calculated during the swap matches the moved images */
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	for (slt = 0; slt < 2; slt++) {
+		zb_img_get_info_nsc(&info, &area, slt, 0, false);
+		zassert_true(info.is_valid, "No image in slot %d", slt);
+		err = zb_img_calc_crc32(&info, &crc32);
+		zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+		zassert_true(crc32 == (slt ? prm.slt1_crc32 : prm.slt0_crc32),
+			     "Wrong crc32 in prm for slot %d", slt);
+		err = zb_crc_tbl_read(&area, slt, 0, &tbl_crc32);
+		zassert_true(err == 0, "No crc for sector: [err %d]", err);
+		err = zb_img_calc_sect_crc32(&info, 0, &crc32);
+		zassert_true(err == 0, "Sector crc failed: [err %d]", err);
+		zassert_true(crc32 == tbl_crc32, "Sector crc differs");
+	}
 }
 
 /**
@@ -168,12 +218,11 @@ void test_zb_image_inplace_move_clr(void)
 	zassert_true(err == 0, "Difference detected in image");
 }
 
-/**
- * @brief Test the in place encrypted move
- */
-void test_zb_image_inplace_move_enc(void)
+/* In place encrypted move, using scratch_cnt scratch sectors */
+static void test_zb_image_inplace_enc(u8_t scratch_cnt)
 {
 	int err, cnt;
+	u32_t scr_start;
 	struct zb_slt_area area;
 	struct zb_cmd cmd;
 	u8_t imgheader[HDR_SIZE];
@@ -183,6 +232,7 @@ void test_zb_image_inplace_move_enc(void)
 	zassert_false(cnt == 0, "Unable to get slotarea count: [cnt %d]", cnt);
 	err = zb_slt_area_get(&area, 0);
 	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+	area.scratch_cnt = scratch_cnt;
 
 	err = zb_flash_erase(area.slt1_fldev, area.slt1_offset, area.slt1_size);
 	zassert_true(err == 0, "Unable to erase image 1 area: [err %d]", err);
@@ -194,15 +244,21 @@ void test_zb_image_inplace_move_enc(void)
 	err = zb_flash_erase(area.swpstat_fldev, area.swpstat_offset,
 			     area.swpstat_size);
 	zassert_true(err == 0, "Unable to erase swpstat area: [err %d]", err);
+	/* the start command holds the scratch rotation start */
+	scr_start = scratch_cnt ? zb_scratch_start(&area) % scratch_cnt : 0;
 	cmd.cmd1 = 0;
 	cmd.cmd2 = CMD2_SWP_START | CMD2_MASK_INPLACE;
-	cmd.cmd3 = 0x0;
+	cmd.cmd3 = scr_start;
 
 	err = zb_cmd_write_swpstat(&area, &cmd);
 	zassert_true(err == 0, "Failed to write command");
 
 	err = zb_img_swap(&area);
 
+	/* the next upgrade continues the rotation after the 2 image sectors */
+	zassert_true(zb_scratch_start(&area) == scr_start + 2,
+		     "Scratch rotation not continued");
+
 	err = zb_flash_read(area.slt1_fldev, area.slt1_offset,
 			    imgheader, HDR_SIZE);
 	zassert_true(err == 0, "Unable to read moved header");
@@ -215,6 +271,747 @@ void test_zb_image_inplace_move_enc(void)
 	err = memcmp(img, &test_image_slt1[HDR_SIZE], 1536 - HDR_SIZE);
 	zassert_true(err == 0, "Difference detected in image");
 
+	/* the move up writes the sector after the image */
+	err = zb_flash_read(area.slt1_fldev, area.slt1_offset + 2 * SECTOR_SIZE,
+			    imgheader, HDR_SIZE);
+	zassert_true(err == 0, "Unable to read sector after image");
+	for (cnt = 0; cnt < HDR_SIZE; cnt++) {
+		if (imgheader[cnt] != EMPTY_U8) {
+			break;
+		}
+	}
+	zassert_true((cnt == HDR_SIZE) == (scratch_cnt != 0),
+		     "Wrong move up use");
+}
+
+/**
+ * @brief Test the in place encrypted move
+ */
+void test_zb_image_inplace_move_enc(void)
+{
+	test_zb_image_inplace_enc(0);
+}
+
+/**
+ * @brief Test the in place encrypted move using a scratch sector
+ */
+void test_zb_image_inplace_move_scr(void)
+{
+	test_zb_image_inplace_enc(1);
+}
+
+/**
+ * @brief Test the scratch rotation of a swap that is resumed in phase 3
+ *
+ * Phase 3 erases the zb_prm that holds the scratch rotation start, a power
+ * fail before the new zb_prm is written is simulated by erasing it before
+ * the swap is resumed. The swap status is placed in the storage partition
+ * to have room for 2 scratch sectors.
+ */
+void test_zb_image_inplace_scr_resume(void)
+{
+	int err;
+	struct zb_slt_area area;
+	struct zb_cmd cmd;
+	struct zb_prm prm;
+	zb_img_swp_step step;
+	u8_t img[1536-HDR_SIZE];
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+	area.swpstat_offset = DT_FLASH_AREA_STORAGE_OFFSET;
+	area.swpstat_size = 4 * SECTOR_SIZE;
+	area.scratch_cnt = 2;
+
+	err = zb_flash_erase(area.slt0_fldev, area.slt0_offset, area.slt0_size);
+	zassert_true(err == 0, "Unable to erase image 0 area: [err %d]", err);
+	memset(&prm, 0, sizeof(prm));
+	prm.prm_ver = ZB_PRM_VERSION;
+	prm.scr_start = 1;
+	err = zb_prm_write(&area, &prm);
+	zassert_true(err == 0, "Unable to write prm: [err %d]", err);
+
+	err = zb_flash_erase(area.slt1_fldev, area.slt1_offset, area.slt1_size);
+	zassert_true(err == 0, "Unable to erase image 1 area: [err %d]", err);
+	err = zb_flash_write(area.slt1_fldev, area.slt1_offset,
+			     test_image_slt1_enc, sizeof(test_image_slt1_enc));
+	zassert_true(err == 0, "Unable to write image data: [err %d]", err);
+	err = zb_flash_erase(area.swpstat_fldev, area.swpstat_offset,
+			     area.swpstat_size);
+	zassert_true(err == 0, "Unable to erase swpstat area: [err %d]", err);
+	cmd.cmd1 = CMD1_MASK_SWP_REQUEST;
+	cmd.cmd2 = 0;
+	cmd.cmd3 = 0;
+	err = zb_cmd_write_slt1end(&area, &cmd);
+	zassert_true(err == 0, "Failed to write request");
+
+	err = zb_img_swap_begin(&area, &step);
+	zassert_true(err == 0, "Swap not started: [err %d]", err);
+	while (step.phase != CMD2_SWP_P3) {
+		err = zb_img_swap_step(&area, &step);
+		zassert_true(err == -EAGAIN, "Swap ended before phase 3");
+	}
+
+	/* power fail after the erase in phase 3 */
+	err = zb_erase_slt0end(&area);
+	zassert_true(err == 0, "Unable to erase slot 0 end: [err %d]", err);
+
+	err = zb_img_swap_begin(&area, &step);
+	zassert_true(err == 0, "Swap not resumed: [err %d]", err);
+	do {
+		err = zb_img_swap_step(&area, &step);
+	} while (err == -EAGAIN);
+	zassert_true(step.phase == CMD2_SWP_END, "Swap not finished");
+
+	/* the next upgrade continues after the 2 image sectors */
+	zassert_true(zb_scratch_start(&area) == 3,
+		     "Scratch rotation restarted");
+
+	err = zb_flash_read(area.slt1_fldev, area.slt1_offset + HDR_SIZE,
+			    img, sizeof(img));
+	zassert_true(err == 0, "Unable to read moved image");
+	err = memcmp(img, &test_image_slt1[HDR_SIZE], sizeof(img));
+	zassert_true(err == 0, "Difference detected in image");
+}
+
+/* Swap image img from slot 1 to slot 0, slot 0 contains test_image_slt0 or
+ * (keep_slt0) the image that is already installed
+ */
+static void test_zb_image_swap_slt1(struct zb_slt_area *area, const u8_t *img,
+				    size_t len, bool keep_slt0)
+{
+	int err;
+	struct zb_cmd cmd;
+
+	if (!keep_slt0) {
+		err = zb_flash_erase(area->slt0_fldev, area->slt0_offset,
+				     area->slt0_size);
+		zassert_true(err == 0, "Unable to erase image 0 area: [err %d]",
+			     err);
+		err = zb_flash_write(area->slt0_fldev, area->slt0_offset,
+				     test_image_slt0, sizeof(test_image_slt0));
+		zassert_true(err == 0, "Unable to write image data: [err %d]",
+			     err);
+	}
+
+	err = zb_flash_erase(area->slt1_fldev, area->slt1_offset,
+			     area->slt1_size);
+	zassert_true(err == 0, "Unable to erase image 1 area: [err %d]", err);
+	err = zb_flash_write(area->slt1_fldev, area->slt1_offset, img, len);
+	zassert_true(err == 0, "Unable to write image data: [err %d]", err);
+
+	err = zb_flash_erase(area->swpstat_fldev, area->swpstat_offset,
+			     area->swpstat_size);
+	zassert_true(err == 0, "Unable to erase swpstat area: [err %d]", err);
+	cmd.cmd1 = 0;
+	cmd.cmd2 = CMD2_SWP_START;
+	cmd.cmd3 = 0x0;
+	err = zb_cmd_write_swpstat(area, &cmd);
+	zassert_true(err == 0, "Failed to write command");
+
+	(void)zb_img_swap(area);
+}
+
+/* Add a tlv entry to the tlv area of img (the signature becomes invalid) */
+static void test_zb_image_add_tlv(u8_t *img, u8_t type, const void *value,
+				  u8_t len)
+{
+	u16_t tlva_size;
+
+	memcpy(&tlva_size, &img[4], sizeof(tlva_size));
+	zassert_true(tlva_size + 2 + len <= HDR_SIZE, "No room for tlv");
+	img[tlva_size] = type;
+	img[tlva_size + 1] = len;
+	memcpy(&img[tlva_size + 2], value, len);
+	tlva_size += 2 + len;
+	memcpy(&img[4], &tlva_size, sizeof(tlva_size));
+}
+
+/* Encrypted test image with a unencrypted hash entry added */
+static void test_zb_image_phash_img(u8_t *img, bool corrupt)
+{
+	struct tc_sha256_state_struct s;
+	u8_t phash[HASH_BYTES];
+
+	memcpy(img, test_image_slt0_enc, sizeof(test_image_slt0_enc));
+	(void)tc_sha256_init(&s);
+	(void)tc_sha256_update(&s, &test_image_slt0[HDR_SIZE],
+			       sizeof(test_image_slt0_enc) - HDR_SIZE);
+	(void)tc_sha256_final(phash, &s);
+	if (corrupt) {
+		phash[0] ^= 0xff;
+	}
+	test_zb_image_add_tlv(img, TLVE_IMAGE_PHASH, phash, HASH_BYTES);
+}
+
+/* Swap image img (with a unencrypted hash entry added) to slot 0 */
+static void test_zb_image_phash_swap(struct zb_slt_area *area, bool corrupt)
+{
+	u8_t img[1536];
+
+	test_zb_image_phash_img(img, corrupt);
+	test_zb_image_swap_slt1(area, img, sizeof(img), false);
+}
+
+/**
+ * @brief Test the unencrypted image hash check during a swap
+ */
+void test_zb_image_classic_move_phash(void)
+{
+	int err;
+	struct zb_slt_area area;
+	struct zb_prm prm;
+	zb_img_info info;
+	u32_t crc32;
+	u8_t imgheader[HDR_SIZE];
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+
+	/* correct hash: image is installed */
+	test_zb_image_phash_swap(&area, false);
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	zassert_true(info.has_phash, "Installed image has no hash");
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_true(crc32 == prm.slt0_crc32, "Installed image rejected");
+
+	/* wrong hash: image is rejected and the previous image restored */
+	test_zb_image_phash_swap(&area, true);
+	err = zb_flash_read(area.slt0_fldev, area.slt0_offset,
+			    imgheader, HDR_SIZE);
+	zassert_true(err == 0, "Unable to read header");
+	err = memcmp(imgheader, test_image_slt0, HDR_SIZE);
+	zassert_true(err == 0, "Previous image not restored");
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_true(crc32 == prm.slt0_crc32, "Restored image not valid");
+}
+
+/* Swap image img (with a sector hash table added) to slot 0 */
+static void test_zb_image_sect_hash_swap(struct zb_slt_area *area,
+					 bool corrupt, u8_t hash_type)
+{
+	struct zb_hash_ctx ctx;
+	zb_tlv_sect_hash sect_hash;
+	u8_t img[1536 + 2 * HASH_BYTES];
+	u8_t *tbl = &img[1536];
+	int sect;
+
+	memcpy(img, test_image_slt0_enc, 1536);
+	for (sect = 0; sect < 2; sect++) {
+		off_t start = MAX(HDR_SIZE, sect * SECTOR_SIZE);
+		off_t end = MIN(1536, (sect + 1) * SECTOR_SIZE);
+
+		(void)zb_hash_init(&ctx, hash_type);
+		(void)zb_hash_update(&ctx, &img[start], end - start);
+		(void)zb_hash_final(&tbl[sect * HASH_BYTES], &ctx);
+	}
+	sect_hash.sect_size = SECTOR_SIZE;
+	(void)zb_hash_init(&ctx, hash_type);
+	(void)zb_hash_update(&ctx, tbl, 2 * HASH_BYTES);
+	(void)zb_hash_final(sect_hash.root, &ctx);
+	test_zb_image_add_tlv(img, TLVE_IMAGE_SECT_HASH, &sect_hash,
+			      sizeof(sect_hash));
+	if (hash_type != HASH_TYPE_SHA256) {
+		test_zb_image_add_tlv(img, TLVE_IMAGE_HASH_TYPE, &hash_type,
+				      TLVE_IMAGE_HASH_TYPE_BYTES);
+	}
+	if (corrupt) {
+		img[1535] ^= 0xff;
+	}
+	test_zb_image_swap_slt1(area, img, sizeof(img), false);
+}
+
+/* Test the sector hash check during a swap */
+static void test_zb_image_sect_hash_move(u8_t hash_type)
+{
+	int err;
+	struct zb_slt_area area;
+	struct zb_prm prm;
+	zb_img_info info;
+	u32_t crc32;
+	u8_t imgheader[HDR_SIZE];
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+
+	/* correct sector hashes: image is installed */
+	test_zb_image_sect_hash_swap(&area, false, hash_type);
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	zassert_true(info.has_sect_hash, "Installed image has no table");
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_true(crc32 == prm.slt0_crc32, "Installed image rejected");
+
+	/* corrupted sector: image is rejected and the previous image restored */
+	test_zb_image_sect_hash_swap(&area, true, hash_type);
+	err = zb_flash_read(area.slt0_fldev, area.slt0_offset,
+			    imgheader, HDR_SIZE);
+	zassert_true(err == 0, "Unable to read header");
+	err = memcmp(imgheader, test_image_slt0, HDR_SIZE);
+	zassert_true(err == 0, "Previous image not restored");
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_true(crc32 == prm.slt0_crc32, "Restored image not valid");
+}
+
+/**
+ * @brief Test the sector hash check during a swap
+ */
+void test_zb_image_classic_move_sect_hash(void)
+{
+	test_zb_image_sect_hash_move(HASH_TYPE_SHA256);
+}
+
+/**
+ * @brief Test the sector hash check during a swap using BLAKE2s hashes
+ */
+void test_zb_image_classic_move_sect_blake2s(void)
+{
+	zb_img_info info;
+	struct zb_slt_area area;
+
+	test_zb_image_sect_hash_move(HASH_TYPE_BLAKE2S);
+
+	/* unknown hash types are not accepted */
+	(void)zb_slt_area_get(&area, 0);
+	test_zb_image_sect_hash_swap(&area, false, 0x7f);
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	zassert_false(info.hash_type == 0x7f, "Unknown hash type installed");
+}
+
+/* Request the in place swap of test_image_slt1_sect (signed with a sector
+ * hash table) through slt1end, optionally with a changed image sector
+ */
+static void test_zb_image_inplace_sect_swap(struct zb_slt_area *area,
+					    bool corrupt)
+{
+	int err;
+	struct zb_cmd cmd;
+	zb_img_swp_step step;
+	u8_t img[sizeof(test_image_slt1_sect)];
+
+	memcpy(img, test_image_slt1_sect, sizeof(img));
+	if (corrupt) {
+		img[HDR_SIZE + 16] ^= 0xff;
+	}
+
+	err = zb_flash_erase(area->slt0_fldev, area->slt0_offset,
+			     area->slt0_size);
+	zassert_true(err == 0, "Unable to erase image 0 area: [err %d]", err);
+	err = zb_flash_erase(area->slt1_fldev, area->slt1_offset,
+			     area->slt1_size);
+	zassert_true(err == 0, "Unable to erase image 1 area: [err %d]", err);
+	err = zb_flash_write(area->slt1_fldev, area->slt1_offset, img,
+			     sizeof(img));
+	zassert_true(err == 0, "Unable to write image data: [err %d]", err);
+	err = zb_erase_swpstat(area);
+	zassert_true(err == 0, "Unable to erase swpstat area: [err %d]", err);
+	cmd.cmd1 = CMD1_MASK_SWP_REQUEST;
+	cmd.cmd2 = 0;
+	cmd.cmd3 = 0;
+	err = zb_cmd_write_slt1end(area, &cmd);
+	zassert_true(err == 0, "Failed to write request");
+
+	/* the check only verifies the table, the swap checks the sectors */
+	err = zb_img_swap_begin(area, &step);
+	zassert_true(err == 0, "Swap not started: [err %d]", err);
+	zassert_true(step.phase != CMD2_SWP_END, "Request not accepted");
+	do {
+		err = zb_img_swap_step(area, &step);
+	} while (err == -EAGAIN);
+	zassert_true(step.phase == CMD2_SWP_END, "Swap not finished");
+}
+
+/**
+ * @brief Test the sector hash check of a image that stays in slot 1
+ */
+void test_zb_image_inplace_sect_hash(void)
+{
+	int err;
+	struct zb_slt_area area;
+	struct zb_prm prm;
+	zb_img_info info;
+	u32_t crc32;
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+
+	/* correct sectors: the image is booted from slot 1 */
+	test_zb_image_inplace_sect_swap(&area, false);
+	zb_img_get_info_nsc(&info, &area, 1, 0, false);
+	zassert_true(info.has_sect_hash, "Image has no table");
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_true(crc32 == prm.slt1_crc32, "Image rejected");
+
+	/* changed sector: the image fails the boot verification */
+	test_zb_image_inplace_sect_swap(&area, true);
+	zb_img_get_info_nsc(&info, &area, 1, 0, false);
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_false(crc32 == prm.slt1_crc32, "Changed image accepted");
+}
+
+/* Swap the compressed image to slot 0, optionally with a corrupted stream */
+static void test_zb_image_cmp_swap(struct zb_slt_area *area, bool corrupt)
+{
+	u8_t img[sizeof(test_image_slt0_cmp)];
+
+	memcpy(img, test_image_slt0_cmp, sizeof(img));
+	if (corrupt) {
+		img[2800] ^= 0x5a;
+	}
+	test_zb_image_swap_slt1(area, img, sizeof(img), false);
+}
+
+/**
+ * @brief Test the expansion of a compressed (and encrypted) image in a swap
+ */
+void test_zb_image_classic_move_cmp(void)
+{
+	int err;
+	struct zb_slt_area area;
+	struct zb_prm prm;
+	zb_img_info info;
+	u32_t crc32;
+	u8_t buf[HDR_SIZE];
+	size_t i;
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+
+	/* valid stream: the expanded image is installed */
+	test_zb_image_cmp_swap(&area, false);
+	for (i = 0; i < 3000; i++) {
+		if ((i % HDR_SIZE) == 0) {
+			err = zb_flash_read(area.slt0_fldev,
+					    area.slt0_offset + HDR_SIZE + i,
+					    buf, HDR_SIZE);
+			zassert_true(err == 0, "Unable to read expanded image");
+		}
+		zassert_true(buf[i % HDR_SIZE] == (((i % 61) ^ (i / 256)) & 0xff),
+			     "Difference detected in expanded image");
+	}
+	err = zb_flash_read(area.slt1_fldev, area.slt1_offset, buf, HDR_SIZE);
+	zassert_true(err == 0, "Unable to read header");
+	err = memcmp(buf, test_image_slt0, HDR_SIZE);
+	zassert_true(err == 0, "Previous image not moved to slot 1");
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_true(crc32 == prm.slt0_crc32, "Installed image rejected");
+
+	/* corrupted stream: image is rejected and the previous image restored */
+	test_zb_image_cmp_swap(&area, true);
+	err = zb_flash_read(area.slt0_fldev, area.slt0_offset, buf, HDR_SIZE);
+	zassert_true(err == 0, "Unable to read header");
+	err = memcmp(buf, test_image_slt0, HDR_SIZE);
+	zassert_true(err == 0, "Previous image not restored");
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_true(crc32 == prm.slt0_crc32, "Restored image not valid");
+}
+
+/* Data of test_image_slt0_delta: the data of test_image_slt0_cmp with
+ * inserted, changed and removed parts
+ */
+static u8_t test_zb_image_delta_data(size_t i)
+{
+	if (i < 700) {
+		return ((i % 61) ^ (i / 256)) & 0xff;
+	}
+	if (i < 732) {
+		return 0xa5;
+	}
+	if ((i >= 2032) && (i < 2132)) {
+		return i - 2032;
+	}
+	return (((i - 32) % 61) ^ ((i - 32) / 256)) & 0xff;
+}
+
+/**
+ * @brief Test the expansion of a delta image against the image in slot 0
+ */
+void test_zb_image_classic_move_delta(void)
+{
+	int err;
+	struct zb_slt_area area;
+	struct zb_prm prm;
+	zb_img_info info;
+	u32_t crc32;
+	u8_t buf[HDR_SIZE];
+	size_t i;
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+
+	/* install the base image */
+	test_zb_image_cmp_swap(&area, false);
+
+	/* the delta is expanded using the base image */
+	test_zb_image_swap_slt1(&area, test_image_slt0_delta,
+				sizeof(test_image_slt0_delta), true);
+	for (i = 0; i < 3032; i++) {
+		if ((i % HDR_SIZE) == 0) {
+			err = zb_flash_read(area.slt0_fldev,
+					    area.slt0_offset + HDR_SIZE + i,
+					    buf, HDR_SIZE);
+			zassert_true(err == 0, "Unable to read expanded image");
+		}
+		zassert_true(buf[i % HDR_SIZE] == test_zb_image_delta_data(i),
+			     "Difference detected in expanded image");
+	}
+	zb_img_get_info_nsc(&info, &area, 0, 0, false);
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_true(crc32 == prm.slt0_crc32, "Installed image rejected");
+
+	/* a delta for another base image is not swapped */
+	test_zb_image_swap_slt1(&area, test_image_slt0_delta,
+				sizeof(test_image_slt0_delta), true);
+	err = zb_prm_read(&area, &prm);
+	zassert_true(err == 0, "Unable to read prm: [err %d]", err);
+	zassert_true(crc32 == prm.slt0_crc32, "Delta to wrong base swapped");
+	err = zb_img_calc_crc32(&info, &crc32);
+	zassert_true(err == 0, "Crc calculation failed: [err %d]", err);
+	zassert_true(crc32 == prm.slt0_crc32, "Installed image changed");
+}
+
+/**
+ * @brief Test the pre-decryption of slot 1 by the application
+ */
+void test_zb_image_predec(void)
+{
+	int err, cnt;
+	struct zb_slt_area area;
+	struct zb_predec pdc;
+	struct zb_cmd cmd;
+	zb_img_info info;
+	u8_t img[1536];
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+
+	err = zb_flash_erase(area.slt1_fldev, area.slt1_offset, area.slt1_size);
+	zassert_true(err == 0, "Unable to erase image 1 area: [err %d]", err);
+	err = zb_flash_write(area.slt1_fldev, area.slt1_offset,
+			     test_image_slt0_enc, sizeof(test_image_slt0_enc));
+	zassert_true(err == 0, "Unable to write image data: [err %d]", err);
+
+	/* scratch sectors and a unencrypted image hash are required */
+	err = zb_predec_init(&pdc, &area);
+	zassert_true(err == -ENOTSUP, "Started without scratch: [err %d]", err);
+	area.scratch_cnt = 1;
+	err = zb_predec_init(&pdc, &area);
+	zassert_true(err == -ENOTSUP, "Started without hash: [err %d]", err);
+
+	/* adding the hash breaks the signature, start by hand */
+	test_zb_image_phash_img(img, false);
+	err = zb_flash_erase(area.slt1_fldev, area.slt1_offset, area.slt1_size);
+	zassert_true(err == 0, "Unable to erase image 1 area: [err %d]", err);
+	err = zb_flash_write(area.slt1_fldev, area.slt1_offset, img,
+			     sizeof(img));
+	zassert_true(err == 0, "Unable to write image data: [err %d]", err);
+	cmd.cmd1 = 0;
+	cmd.cmd2 = CMD2_PDC_P1;
+	cmd.cmd3 = 1;
+	err = zb_cmd_write_slt1end(&area, &cmd);
+	zassert_true(err == 0, "Failed to write command");
+
+	err = zb_predec_init(&pdc, &area);
+	zassert_true(err == 0, "Pre-decryption not started: [err %d]", err);
+	for (cnt = 0; cnt < 3; cnt++) {
+		err = zb_predec_step(&pdc);
+		zassert_true(err == -EAGAIN, "Wrong step result: [err %d]", err);
+	}
+
+	/* interrupted while the header sector is decrypted */
+	err = zb_predec_init(&pdc, &area);
+	zassert_true(err == 0, "Pre-decryption not continued: [err %d]", err);
+	err = zb_predec_step(&pdc);
+	zassert_true(err == 0, "Pre-decryption not done: [err %d]", err);
+
+	zb_img_get_info_nsc(&info, &area, 1, 0, true);
+	zassert_true(info.is_valid, "Pre-decrypted image not valid");
+	zassert_true(info.is_predec, "Image not marked as pre-decrypted");
+	err = zb_flash_read(area.slt1_fldev, area.slt1_offset, img,
+			    sizeof(img));
+	zassert_true(err == 0, "Unable to read image");
+	err = memcmp(&img[HDR_SIZE], &test_image_slt0[HDR_SIZE],
+		     sizeof(img) - HDR_SIZE);
+	zassert_true(err == 0, "Difference detected in image");
+
+	/* the swap moves the image without decryption */
+	test_zb_image_swap_slt1(&area, img, sizeof(img), true);
+	err = zb_flash_read(area.slt0_fldev, area.slt0_offset, img,
+			    sizeof(img));
+	zassert_true(err == 0, "Unable to read moved image");
+	zassert_true(img[offsetof(tlv_area_hdr, tlva_type)] &
+		     TLVA_TYPE_DECRYPTED, "Moved image not pre-decrypted");
+	err = memcmp(&img[HDR_SIZE], &test_image_slt0[HDR_SIZE],
+		     sizeof(img) - HDR_SIZE);
+	zassert_true(err == 0, "Difference detected in moved image");
+}
+
+/**
+ * @brief Test the swap done in steps
+ */
+void test_zb_image_swap_steps(void)
+{
+	int err;
+	struct zb_slt_area area;
+	struct zb_cmd cmd;
+	zb_img_swp_step step;
+	u16_t remaining;
+	u8_t img[1536];
+
+	err = zb_slt_area_get(&area, 0);
+	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+
+	err = zb_flash_erase(area.slt0_fldev, area.slt0_offset, area.slt0_size);
+	zassert_true(err == 0, "Unable to erase image 0 area: [err %d]", err);
+	err = zb_flash_write(area.slt0_fldev, area.slt0_offset,
+			     test_image_slt1, sizeof(test_image_slt1));
+	zassert_true(err == 0, "Unable to write image data: [err %d]", err);
+	err = zb_flash_erase(area.slt1_fldev, area.slt1_offset, area.slt1_size);
+	zassert_true(err == 0, "Unable to erase image 1 area: [err %d]", err);
+	err = zb_flash_write(area.slt1_fldev, area.slt1_offset,
+			     test_image_slt0_enc, sizeof(test_image_slt0_enc));
+	zassert_true(err == 0, "Unable to write image data: [err %d]", err);
+
+	err = zb_flash_erase(area.swpstat_fldev, area.swpstat_offset,
+			     area.swpstat_size);
+	zassert_true(err == 0, "Unable to erase swpstat area: [err %d]", err);
+	cmd.cmd1 = 0;
+	cmd.cmd2 = CMD2_SWP_START;
+	cmd.cmd3 = 0x0;
+	err = zb_cmd_write_swpstat(&area, &cmd);
+	zassert_true(err == 0, "Failed to write command");
+
+	err = zb_img_swap_begin(&area, &step);
+	zassert_true(err == 0, "Swap not started: [err %d]", err);
+	zassert_true(step.phase == CMD2_SWP_START, "Wrong phase");
+
+	/* every step reduces the remaining work */
+	do {
+		remaining = step.remaining;
+		err = zb_img_swap_step(&area, &step);
+		zassert_true(step.remaining < remaining, "No progress reported");
+	} while (err == -EAGAIN);
+	zassert_true(err == 0, "Swap failed: [err %d]", err);
+	zassert_true(step.phase == CMD2_SWP_END, "Swap not finished");
+	zassert_true(step.done == 10, "Wrong step count: %d", step.done);
+
+	err = zb_flash_read(area.slt0_fldev, area.slt0_offset, img,
+			    sizeof(img));
+	zassert_true(err == 0, "Unable to read moved image");
+	err = memcmp(&img[HDR_SIZE], &test_image_slt0[HDR_SIZE],
+		     sizeof(img) - HDR_SIZE);
+	zassert_true(err == 0, "Difference detected in moved image");
+	err = zb_flash_read(area.slt1_fldev, area.slt1_offset, img,
+			    sizeof(img));
+	zassert_true(err == 0, "Unable to read moved image");
+	err = memcmp(img, test_image_slt1, sizeof(img));
+	zassert_true(err == 0, "Difference detected in swapped image");
+}
+
+/**
+ * @brief Test the swaps with non uniform sectors
+ *
+ * The slot area slot_map[1] is on a test flash device with the 16/64/128 KiB
+ * layout of a STM32F4 scaled to SECTOR_SIZE (see flash_nu.h): sector 0 is
+ * SECTOR_SIZE, sector 1 is 4 times and the sectors after it 8 times
+ * SECTOR_SIZE. The sector map is made from the page layout by
+ * zb_slt_area_get(), it requires CONFIG_FLASH_PAGE_LAYOUT.
+ */
+void test_zb_image_nonuniform_move(void)
+{
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	int err;
+	struct zb_slt_area area;
+	struct zb_cmd cmd;
+	size_t size;
+	off_t off;
+	u8_t img[1536];
+
+	zassert_true(zb_slt_area_cnt() == 2, "No non uniform slot area");
+	err = zb_slt_area_get(&area, 1);
+	zassert_true(err == 0, "Unable to get slotarea info: [err %d]", err);
+	zassert_true(area.slt0_size >= 13 * SECTOR_SIZE, "Slot too small");
+
+	zassert_false(zb_sector_uniform(&area), "Sectors uniform");
+	zassert_true(area.sect_run_cnt == 3, "Bad sector map");
+	off = zb_sector_offset(&area, 3, &size);
+	zassert_true((off == 13 * SECTOR_SIZE) && (size == 8 * SECTOR_SIZE),
+		     "Bad sector 3");
+	zassert_true(zb_sector_cnt(&area, SECTOR_SIZE + 1) == 2,
+		     "Bad sector count");
+	zassert_true(zb_sector_cnt(&area, area.slt0_size) ==
+		     2 + (area.slt0_size - 5 * SECTOR_SIZE) / (8 * SECTOR_SIZE),
+		     "Bad sector count");
+	zassert_true(zb_sector_last(&area, 0) == 8 * SECTOR_SIZE,
+		     "Bad last sector");
+
+	/* classic swap, the image in slot 0 is moved up */
+	test_zb_image_swap_slt1(&area, test_image_slt0_enc,
+				sizeof(test_image_slt0_enc), false);
+	err = zb_flash_read(area.slt0_fldev, area.slt0_offset, img,
+			    sizeof(img));
+	zassert_true(err == 0, "Unable to read moved image");
+	err = memcmp(&img[HDR_SIZE], &test_image_slt0[HDR_SIZE],
+		     sizeof(img) - HDR_SIZE);
+	zassert_true(err == 0, "Difference detected in moved image");
+	err = zb_flash_read(area.slt1_fldev, area.slt1_offset, img,
+			    sizeof(img));
+	zassert_true(err == 0, "Unable to read swapped image");
+	err = memcmp(img, test_image_slt0, sizeof(img));
+	zassert_true(err == 0, "Difference detected in swapped image");
+
+	/* in place swap, the image in slot 1 is moved up */
+	err = zb_flash_erase(area.slt1_fldev, area.slt1_offset, area.slt1_size);
+	zassert_true(err == 0, "Unable to erase image 1 area: [err %d]", err);
+	err = zb_flash_write(area.slt1_fldev, area.slt1_offset,
+			     test_image_slt1_enc, sizeof(test_image_slt1_enc));
+	zassert_true(err == 0, "Unable to write image data: [err %d]", err);
+	err = zb_erase_swpstat(&area);
+	zassert_true(err == 0, "Unable to erase swpstat area: [err %d]", err);
+	cmd.cmd1 = 0;
+	cmd.cmd2 = CMD2_SWP_START | CMD2_MASK_INPLACE;
+	cmd.cmd3 = 0x0;
+	err = zb_cmd_write_swpstat(&area, &cmd);
+	zassert_true(err == 0, "Failed to write command");
+	(void)zb_img_swap(&area);
+
+	err = zb_flash_read(area.slt1_fldev, area.slt1_offset, img,
+			    sizeof(img));
+	zassert_true(err == 0, "Unable to read moved image");
+	err = memcmp(&img[HDR_SIZE], &test_image_slt1[HDR_SIZE],
+		     sizeof(img) - HDR_SIZE);
+	zassert_true(err == 0, "Difference detected in moved image");
+#endif
 }
 
 void test_zb_move(void)
@@ -223,7 +1020,18 @@ void test_zb_move(void)
 			 ztest_unit_test(test_zb_image_classic_move_clr),
 			 ztest_unit_test(test_zb_image_classic_move_enc),
 			 ztest_unit_test(test_zb_image_inplace_move_clr),
-			 ztest_unit_test(test_zb_image_inplace_move_enc)
+			 ztest_unit_test(test_zb_image_inplace_move_enc),
+			 ztest_unit_test(test_zb_image_inplace_move_scr),
+			 ztest_unit_test(test_zb_image_inplace_scr_resume),
+			 ztest_unit_test(test_zb_image_classic_move_phash),
+			 ztest_unit_test(test_zb_image_classic_move_sect_hash),
+			 ztest_unit_test(test_zb_image_classic_move_sect_blake2s),
+			 ztest_unit_test(test_zb_image_inplace_sect_hash),
+			 ztest_unit_test(test_zb_image_classic_move_cmp),
+			 ztest_unit_test(test_zb_image_classic_move_delta),
+			 ztest_unit_test(test_zb_image_predec),
+			 ztest_unit_test(test_zb_image_swap_steps),
+			 ztest_unit_test(test_zb_image_nonuniform_move)
 			);
 
 	ztest_run_test_suite(test_zb_move);
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2019 Laczen
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <ztest.h>
+#include <errno.h>
+#include "../../zepboot/include/zb_ret.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(test_zb_ret);
+
+/**
+ * @brief Test write, read and clear of a retained block
+ */
+void test_zb_ret_rw(void)
+{
+	int err;
+	struct zb_ret ret;
+
+	zb_ret_clear(&ret);
+	err = zb_ret_read(&ret);
+	zassert_true(err == -ENOENT, "Cleared retained block is valid");
+
+	zb_ret_write(&ret, 0x11200, 0x12345678, 3);
+	err = zb_ret_read(&ret);
+	zassert_true(err == 0, "Retained block is invalid: [err %d]", err);
+	zassert_true(ret.boot_address == 0x11200, "Wrong boot address");
+	zassert_true(ret.img_crc32 == 0x12345678, "Wrong image crc32");
+	zassert_true(ret.vfy_sect == 3, "Wrong verification sector");
+
+	/* a modified block breaks the seal */
+	ret.boot_address++;
+	err = zb_ret_read(&ret);
+	zassert_true(err == -ENOENT, "Modified retained block is valid");
+}
+
+void test_zb_ret(void)
+{
+	ztest_test_suite(test_zb_ret,
+			 ztest_unit_test(test_zb_ret_rw)
+			);
+
+	ztest_run_test_suite(test_zb_ret);
+}
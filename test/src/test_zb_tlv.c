@@ -16,6 +16,7 @@ LOG_MODULE_REGISTER(test_zb_tlv);
 
 extern u8_t test_msg[];
 extern u8_t test_signature[];
+extern u8_t test_ed25519_signature[];
 
 #define HAYSTACK_BYTES 16
 u8_t test_haystack[HAYSTACK_BYTES] = {
@@ -87,6 +88,8 @@ void test_zb_tlv_open_unsigned(void)
 
 	hdr.tlva_magic = TLV_AREA_MAGIC;
 	hdr.tlva_size = sizeof(ext_haystack);
+	hdr.tlva_type = 0;
+	hdr.tlva_sig_type = TLVA_SIG_TYPE_EC256;
 	memcpy(&hdr.tlva_signature, test_signature, SIGNATURE_BYTES);
 
 	cnt = zb_slt_area_cnt();
@@ -150,6 +153,8 @@ void test_zb_tlv_open_signed(void)
 
 	hdr.tlva_magic = TLV_AREA_MAGIC;
 	hdr.tlva_size = sizeof(ext_haystack);
+	hdr.tlva_type = 0;
+	hdr.tlva_sig_type = TLVA_SIG_TYPE_EC256;
 	memcpy(&hdr.tlva_signature, test_signature, SIGNATURE_BYTES);
 
 	cnt = zb_slt_area_cnt();
@@ -172,6 +177,36 @@ void test_zb_tlv_open_signed(void)
 	zassert_true(ext_haystack_size == HASH_BYTES,
 		     "Incorrect tlv length");
 
+	/* same tlv area signed with a ed25519 root key */
+	hdr.tlva_sig_type = TLVA_SIG_TYPE_ED25519;
+	memcpy(&hdr.tlva_signature, test_ed25519_signature, SIGNATURE_BYTES);
+
+	err = zb_flash_erase(area.slt0_fldev, area.slt0_offset, area.slt0_size);
+	zassert_true(err == 0,  "Unable to erase image 0 area: [err %d]", err);
+
+	memcpy(ext_haystack, &hdr, sizeof(tlv_area_hdr));
+	memcpy(ext_haystack + sizeof(tlv_area_hdr), test_msg, HASH_BYTES);
+	err = zb_flash_write(area.slt0_fldev, area.slt0_offset, ext_haystack,
+			     sizeof(ext_haystack));
+
+	ext_haystack_size = zb_open_tlv_area(area.slt0_fldev, area.slt0_offset,
+					     ext_haystack, true);
+	zassert_true(ext_haystack_size == HASH_BYTES, "Tlv open error");
+
+	/* the ed25519 signature is not a valid ec256 signature */
+	hdr.tlva_sig_type = TLVA_SIG_TYPE_EC256;
+	err = zb_flash_erase(area.slt0_fldev, area.slt0_offset, area.slt0_size);
+	zassert_true(err == 0,  "Unable to erase image 0 area: [err %d]", err);
+
+	memcpy(ext_haystack, &hdr, sizeof(tlv_area_hdr));
+	memcpy(ext_haystack + sizeof(tlv_area_hdr), test_msg, HASH_BYTES);
+	err = zb_flash_write(area.slt0_fldev, area.slt0_offset, ext_haystack,
+			     sizeof(ext_haystack));
+
+	ext_haystack_size = zb_open_tlv_area(area.slt0_fldev, area.slt0_offset,
+					     ext_haystack, true);
+	zassert_true(ext_haystack_size < 0, "Wrong signature type accepted");
+
 }
 
 
@@ -10,6 +10,8 @@
  */
 #include <zephyr.h>
 #include "../../zepboot/include/zb_ec256.h"
+#include "../../zepboot/include/zb_ed25519.h"
+#include "../../zepboot/include/zb_chacha.h"
 
 u8_t test_msg[HASH_BYTES] = {
 	0xff, 0xfe, 0xfd, 0xfc, 0xfb, 0xfa, 0xf9, 0xf8,
@@ -39,6 +41,41 @@ u8_t test_signature[SIGNATURE_BYTES] = {
 	238, 129, 253, 12, 66, 182, 43, 27
 };
 
+/* RFC 8032 test 3 */
+u8_t test_ed25519_rfc_msg[2] = {
+	0xaf, 0x82
+};
+
+u8_t test_ed25519_rfc_pub_key[ED25519_PUBLIC_KEY_BYTES] = {
+	0xfc, 0x51, 0xcd, 0x8e, 0x62, 0x18, 0xa1, 0xa3,
+	0x8d, 0xa4, 0x7e, 0xd0, 0x02, 0x30, 0xf0, 0x58,
+	0x08, 0x16, 0xed, 0x13, 0xba, 0x33, 0x03, 0xac,
+	0x5d, 0xeb, 0x91, 0x15, 0x48, 0x90, 0x80, 0x25
+};
+
+u8_t test_ed25519_rfc_signature[ED25519_SIGNATURE_BYTES] = {
+	0x62, 0x91, 0xd6, 0x57, 0xde, 0xec, 0x24, 0x02,
+	0x48, 0x27, 0xe6, 0x9c, 0x3a, 0xbe, 0x01, 0xa3,
+	0x0c, 0xe5, 0x48, 0xa2, 0x84, 0x74, 0x3a, 0x44,
+	0x5e, 0x36, 0x80, 0xd7, 0xdb, 0x5a, 0xc3, 0xac,
+	0x18, 0xff, 0x9b, 0x53, 0x8d, 0x16, 0xf2, 0x90,
+	0xae, 0x67, 0xf7, 0x60, 0x98, 0x4d, 0xc6, 0x59,
+	0x4a, 0x7c, 0x15, 0xe9, 0x71, 0x6e, 0xd2, 0x8d,
+	0xc0, 0x27, 0xbe, 0xce, 0xea, 0x1e, 0xc4, 0x0a
+};
+
+/* test_msg_hash signed with the ed25519 root key */
+u8_t test_ed25519_signature[ED25519_SIGNATURE_BYTES] = {
+	0xe9, 0xd1, 0xda, 0x49, 0xcb, 0xfa, 0xf8, 0xad,
+	0x04, 0xef, 0x1d, 0x61, 0x5d, 0x3f, 0x15, 0xdc,
+	0xe8, 0x8e, 0xbc, 0xf2, 0xc5, 0x45, 0x47, 0xd3,
+	0x07, 0x98, 0x2b, 0x03, 0x34, 0x46, 0xab, 0xae,
+	0x29, 0x84, 0xcb, 0xf1, 0xc7, 0xd7, 0x3b, 0x0c,
+	0x40, 0xa0, 0x46, 0x3c, 0x01, 0x08, 0xf6, 0xee,
+	0x8f, 0xc4, 0x0e, 0x39, 0x80, 0xdd, 0xab, 0x00,
+	0xfc, 0x7b, 0x53, 0xbe, 0x27, 0x02, 0x35, 0x04
+};
+
 u8_t test_enc_pub_key[PUBLIC_KEY_BYTES] = {
 	162, 232, 188, 223, 146, 244, 15, 182,
 	171, 144, 101, 158, 237, 57, 205, 66,
@@ -53,4 +90,38 @@ u8_t test_enc_pub_key[PUBLIC_KEY_BYTES] = {
 u8_t test_enc_key[16] = {
 	100, 94, 130, 145, 92, 49, 78, 162,
 	75, 150, 19, 98, 20, 112, 197, 170
-};
\ No newline at end of file
+};
+/* RFC 7539 section 2.4.2 test vector, the keystream starts at block 1 */
+u8_t test_chacha20_rfc_key[CHACHA20_KEY_BYTES] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+	0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+};
+
+u8_t test_chacha20_rfc_nonce[CHACHA20_NONCE_BYTES] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4a,
+	0x00, 0x00, 0x00, 0x00
+};
+
+u8_t test_chacha20_rfc_msg[114] =
+	"Ladies and Gentlemen of the class of '99: If I could offer you "
+	"only one tip for the future, sunscreen would be it.";
+
+u8_t test_chacha20_rfc_enc[114] = {
+	0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80,
+	0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+	0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2,
+	0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+	0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab,
+	0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+	0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab,
+	0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+	0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61,
+	0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+	0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06,
+	0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+	0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6,
+	0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+	0x87, 0x4d
+};
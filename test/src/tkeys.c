@@ -50,4 +50,13 @@ const unsigned char ec256_root_pub_key[] = {
 	0x90, 0xd9, 0x95, 0xad, 0x97, 0x77, 0x02, 0x2f
 };
 
-const unsigned int ec256_root_pub_key_len = 192;
\ No newline at end of file
+const unsigned int ec256_root_pub_key_len = 192;
+
+const unsigned char ed25519_root_pub_key[] = {
+	0xd7, 0x5a, 0x98, 0x01, 0x82, 0xb1, 0x0a, 0xb7,
+	0xd5, 0x4b, 0xfe, 0xd3, 0xc9, 0x64, 0x07, 0x3a,
+	0x0e, 0xe1, 0x72, 0xf3, 0xda, 0xa6, 0x23, 0x25,
+	0xaf, 0x02, 0x1a, 0x68, 0xf7, 0x07, 0x51, 0x1a,
+};
+
+const unsigned int ed25519_root_pub_key_len = 32;
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2019 LaczenJMS.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+ #ifndef H_ZB_BLAKE2S_
+ #define H_ZB_BLAKE2S_
+
+#include <sys/types.h>
+#include <zephyr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLAKE2S_BLOCK_BYTES	64
+#define BLAKE2S_HASH_BYTES	32
+
+struct zb_blake2s_state {
+	u32_t h[8];
+	u32_t t[2];
+	u8_t buf[BLAKE2S_BLOCK_BYTES];
+	size_t len;
+};
+
+/**
+ * @brief BLAKE2S API (unkeyed BLAKE2s-256, RFC 7693)
+ * @{
+ */
+
+/**
+ * @brief zb_blake2s_init
+ *
+ * @param s: blake2s state
+ */
+void zb_blake2s_init(struct zb_blake2s_state *s);
+
+/**
+ * @brief zb_blake2s_update
+ *
+ * @param s: blake2s state
+ * @param data: data to add to the hash
+ * @param len: data length
+ */
+void zb_blake2s_update(struct zb_blake2s_state *s, const u8_t *data,
+		       size_t len);
+
+/**
+ * @brief zb_blake2s_final
+ *
+ * @param hash: calculated hash (BLAKE2S_HASH_BYTES)
+ * @param s: blake2s state
+ */
+void zb_blake2s_final(u8_t *hash, struct zb_blake2s_state *s);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2019 LaczenJMS.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef H_ZB_CHACHA_
+#define H_ZB_CHACHA_
+
+#include <sys/types.h>
+#include <zephyr.h>
+
+#define CHACHA20_KEY_BYTES	32
+#define CHACHA20_NONCE_BYTES	12
+#define CHACHA20_BLOCK_BYTES	64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief zb_chacha20_ctx: ChaCha20 (RFC 7539) stream cipher context
+ */
+struct zb_chacha20_ctx {
+	u32_t state[16];		 /* key, nonce and next block counter */
+	u8_t ks[CHACHA20_BLOCK_BYTES]; /* keystream of the current block */
+	u8_t ks_off;			 /* used keystream bytes */
+};
+
+/** @brief chacha API
+ * @{
+ */
+
+/**
+ * @brief zb_chacha20_init
+ *
+ * setup the cipher context at stream offset 0
+ *
+ * @param ctx cipher context
+ * @param key key (CHACHA20_KEY_BYTES)
+ * @param nonce nonce (CHACHA20_NONCE_BYTES), NULL for a zero nonce
+ */
+void zb_chacha20_init(struct zb_chacha20_ctx *ctx, const u8_t *key,
+		      const u8_t *nonce);
+
+/**
+ * @brief zb_chacha20_seek
+ *
+ * set the stream offset, the block counter is derived from the offset so
+ * any position in the stream can be started directly
+ *
+ * @param ctx cipher context
+ * @param offset stream offset in bytes
+ */
+void zb_chacha20_seek(struct zb_chacha20_ctx *ctx, u32_t offset);
+
+/**
+ * @brief zb_chacha20_xor
+ *
+ * encrypt / decrypt a buffer at the current stream offset, the stream offset
+ * is advanced by len
+ *
+ * @param ctx cipher context
+ * @param buf pointer to buffer to encrypt / encrypted buffer
+ * @param len bytes to encrypt
+ */
+void zb_chacha20_xor(struct zb_chacha20_ctx *ctx, u8_t *buf, size_t len);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
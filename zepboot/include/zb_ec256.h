@@ -8,7 +8,9 @@
 
 #include <sys/types.h>
 #include <tinycrypt/ecc.h>
+#include <tinycrypt/sha256.h>
 #include <device.h>
+#include "zb_blake2s.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,8 +22,21 @@ extern "C" {
 #define SHARED_SECRET_BYTES	NUM_ECC_BYTES
 #define VERIFY_BYTES		NUM_ECC_BYTES
 #define HASH_BYTES 		NUM_ECC_BYTES
+#define KEY_ID_BYTES		4
 #define HASH_FLASH_BUFFER_BYTES	256
 
+/* Hash types used for image hashes, the tlv area is always hashed with SHA256 */
+#define HASH_TYPE_SHA256	0x00
+#define HASH_TYPE_BLAKE2S	0x01
+
+struct zb_hash_ctx {
+	u8_t type;
+	union {
+		struct tc_sha256_state_struct sha256;
+		struct zb_blake2s_state blake2s;
+	};
+};
+
 /**
  * @brief EC256 API
  * @{
@@ -55,6 +70,94 @@ int zb_get_encr_key(u8_t *key, const u8_t *pubkey, u8_t keysize);
  */
 int zb_sign_verify(const u8_t *hash, const u8_t *signature);
 
+/**
+ * @brief zb_sign_verify_id
+ *
+ * Verifies the signature like zb_sign_verify, but only the root keys with a
+ * key id equal to key_id are used. When key_id is NULL all root keys are
+ * tried.
+ *
+ * @param hash: calculated message hash
+ * @param signature: message hash signature
+ * @param key_id: key id (KEY_ID_BYTES) of the signing key or NULL
+ * @retval -ERRNO errno code if error
+ * @retval 0 if succesfull
+ */
+int zb_sign_verify_id(const u8_t *hash, const u8_t *signature,
+		      const u8_t *key_id);
+
+/**
+ * @brief zb_key_id
+ *
+ * Calculates the key id of a public key: the first KEY_ID_BYTES of the hash
+ * (SHA256) over the public key.
+ *
+ * @param key_id: calculated key id
+ * @param pubkey: public key
+ * @param len: public key length
+ * @retval -ERRNO errno code if error
+ * @retval 0 if succesfull
+ */
+int zb_key_id(u8_t *key_id, const u8_t *pubkey, size_t len);
+
+/**
+ * @brief zb_hash_init
+ *
+ * Starts a hash (HASH_BYTES) calculation of the given type.
+ *
+ * @param ctx: hash context
+ * @param type: hash type (HASH_TYPE_SHA256 or HASH_TYPE_BLAKE2S)
+ * @retval -ERRNO errno code if error
+ * @retval 0 if succesfull
+ */
+int zb_hash_init(struct zb_hash_ctx *ctx, u8_t type);
+
+/**
+ * @brief zb_hash_update
+ *
+ * @param ctx: hash context
+ * @param data: data to add to the hash
+ * @param len: data length
+ * @retval -ERRNO errno code if error
+ * @retval 0 if succesfull
+ */
+int zb_hash_update(struct zb_hash_ctx *ctx, const u8_t *data, size_t len);
+
+/**
+ * @brief zb_hash_final
+ *
+ * @param hash: calculated hash
+ * @param ctx: hash context
+ * @retval -ERRNO errno code if error
+ * @retval 0 if succesfull
+ */
+int zb_hash_final(u8_t *hash, struct zb_hash_ctx *ctx);
+
+/**
+ * @brief zb_wdt_feed
+ *
+ * Called before each block that is read by zb_hash_flash_type() and
+ * zb_crc32_flash(). The default does nothing, the bootloader replaces it to
+ * feed the watchdog.
+ */
+void zb_wdt_feed(void);
+
+/**
+ * @brief zb_hash_flash_type
+ *
+ * Calculates the hash of the given type over a region in flash.
+ *
+ * @param hash: calculated hash
+ * @param type: hash type (HASH_TYPE_SHA256 or HASH_TYPE_BLAKE2S)
+ * @param flash_dev: flash device of the region
+ * @param off: offset of region in flash
+ * @param len: region length
+ * @retval -ERRNO errno code if error
+ * @retval 0 if succesfull
+ */
+int zb_hash_flash_type(u8_t *hash, u8_t type, struct device *fl_dev, off_t off,
+		       size_t len);
+
 /**
  * @brief hash_flash
  *
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2019 LaczenJMS.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+ #ifndef H_ZB_ED25519_
+ #define H_ZB_ED25519_
+
+#include <sys/types.h>
+#include <zephyr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ED25519_SIGNATURE_BYTES		64
+#define ED25519_PUBLIC_KEY_BYTES	32
+
+/**
+ * @brief ED25519 API
+ * @{
+ */
+
+/**
+ * @brief zb_ed25519_verify
+ *
+ * Verifies a ed25519 signature over a message.
+ *
+ * @param msg: message
+ * @param len: message length
+ * @param signature: message signature
+ * @param pubkey: public key
+ * @retval -ERRNO errno code if error
+ * @retval 0 if succesfull
+ */
+int zb_ed25519_verify(const u8_t *msg, size_t len, const u8_t *signature,
+		      const u8_t *pubkey);
+
+/**
+ * @brief zb_ed25519_sign_verify
+ *
+ * Verifies the ed25519 signature over the hash. This routine uses the ed25519
+ * public root keys that are stored in the bootloader. When key_id is not NULL
+ * only the root keys with the same key id are used.
+ *
+ * @param hash: calculated message hash
+ * @param signature: message hash signature
+ * @param key_id: key id (KEY_ID_BYTES) of the signing key or NULL
+ * @retval -ERRNO errno code if error
+ * @retval 0 if succesfull
+ */
+int zb_ed25519_sign_verify(const u8_t *hash, const u8_t *signature,
+			   const u8_t *key_id);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -16,7 +16,21 @@
 extern "C" {
 #endif
 
+/*
+ * SECTOR_SIZE is the unit of the swap (a sector), it defaults to the erase
+ * block size of the soc flash. When slot areas are (partly) placed on a device
+ * with larger erase pages (e.g. external NOR flash with 4 KiB or 64 KiB blocks)
+ * it can be set to a multiple of the erase pages of all devices with
+ * CONFIG_ZB_SECTOR_SIZE (in prj.conf) or ZB_SECTOR_SIZE, a sector then covers
+ * one or more erase pages of each device.
+ */
+#if defined(CONFIG_ZB_SECTOR_SIZE) && (CONFIG_ZB_SECTOR_SIZE > 0)
+#define SECTOR_SIZE CONFIG_ZB_SECTOR_SIZE
+#elif defined(ZB_SECTOR_SIZE)
+#define SECTOR_SIZE ZB_SECTOR_SIZE
+#else
 #define SECTOR_SIZE DT_FLASH_ERASE_BLOCK_SIZE
+#endif
 #define EMPTY_U8 0xff
 #define EMPTY_U32 0xffffffff
 #define ALIGN_BUF_SIZE	16
@@ -29,6 +43,8 @@ BUILD_ASSERT_MSG(DT_FLASH_WRITE_BLOCK_SIZE < ALIGN_BUF_SIZE,
 
 size_t zb_flash_align_size(struct device *flash_dev, size_t len);
 off_t zb_flash_align_offset(struct device *flash_dev, off_t offset);
+int zb_flash_layout_check(struct device *flash_dev, off_t offset, size_t len,
+			  size_t unit);
 int zb_flash_erase(struct device *flash_dev, off_t offset, size_t len);
 int zb_flash_write(struct device *flash_dev, off_t offset,
 		   const void *data, size_t len);
@@ -62,16 +78,62 @@ bool zb_in_ram(off_t address);
  * The last sector of slot0 (slt0end) is used during the swap process to
  * temporarily store data of the image in slot0. After the swap is finished it
  * is used to store parameters of the images in slot0 and slot1 (crc32 over the
- * image, version and load address of both images). After the parameters
- * commands can be written to keep track of the boot count for test images.
+ * image, version, load address, start and size of both images). After a swap
+ * the bootloader can boot using these parameters without parsing the image
+ * headers. The parameters are followed by a table with the crc32 of each image
+ * sector (see zb_crc_tbl). After the parameters and the table commands can be
+ * written to keep track of the boot count for test images.
  *
  * The last sector of slot1 (slt1end) is used during the swap process to
  * temporarily store data of the image in slot1 (only in the case of an inplace
  * decryption). After the swap is finished it is used to write commands to
  * communicate with the bootloader (e.g. start a swap, override the boot count
  * limit, ...)
+ *
+ * The last scratch_cnt sectors of the swap status area can be used as scratch
+ * for the inplace decryption of encrypted images: each sector is copied to
+ * scratch and decrypted back, this replaces the move up. The sectors are used
+ * in rotation, the rotation continues where the previous upgrade stopped (kept
+ * in zb_prm). The swap status commands are written to the remaining part of
+ * the swap status area. With scratch_cnt 0 the inplace decryption uses a move
+ * up. Each scratch sector is erased (slot sectors / scratch_cnt) times per
+ * upgrade, a slot area where this exceeds ZB_SCRATCH_WEAR is rejected.
+ *
+ * When several slot areas have a swap pending the bootloader swaps them in
+ * order of prio (lowest value first). A swap in a area with a swp_budget_ms
+ * stops when the time since reset exceeds the budget, it is continued on a
+ * later boot. The swap of slot_map[0] (the booted area) is always completed.
+ *
+ * Slot 0, slot 1 and the swap status area can be on different devices with a
+ * different erase page size. Sector n of slot 0 and sector n of slot 1 are at
+ * the same offset from the slot start, on each device a sector consists of
+ * complete erase pages. With CONFIG_FLASH_PAGE_LAYOUT the sectors follow the
+ * page layout (non uniform sectors, e.g. 16/64/128 KiB): the sector size can
+ * only increase towards the slot end and slt0end/slt1end are the last sector of
+ * the slot. Scratch sectors are SECTOR_SIZE, they require uniform sectors.
  */
 
+/*
+ * The sector map of a slot area is made by zb_slt_area_get(): consecutive
+ * sectors of the same size form a run, a non uniform layout has a run for each
+ * sector size (e.g. 16/64/128 KiB). The map has at most ZB_SECTOR_RUNS runs, a
+ * slot area with more different sector sizes is rejected.
+ */
+#ifndef ZB_SECTOR_RUNS
+#define ZB_SECTOR_RUNS 4
+#endif
+
+struct zb_sector_run {
+    u32_t  off;		/* offset of the first sector from the slot start */
+    u32_t  size;	/* size of each sector in the run */
+    u16_t  sect;	/* index of the first sector */
+};
+
+/* Maximum number of erases of a scratch sector for one upgrade */
+#ifndef ZB_SCRATCH_WEAR
+#define ZB_SCRATCH_WEAR 8
+#endif
+
 struct slt_area {
     off_t  slt0_offset;
     off_t  slt1_offset;
@@ -82,6 +144,9 @@ struct slt_area {
     const char *slt0_devname;
     const char *slt1_devname;
     const char *swpstat_devname;
+    u8_t   scratch_cnt;
+    u8_t   prio;
+    u16_t  swp_budget_ms;
 };
 
 struct zb_slt_area {
@@ -94,6 +159,13 @@ struct zb_slt_area {
     struct device *slt0_fldev;
     struct device *slt1_fldev;
     struct device *swpstat_fldev;
+    u8_t   scratch_cnt;
+    u8_t   prio;
+    u16_t  swp_budget_ms;
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+    struct zb_sector_run sect_run[ZB_SECTOR_RUNS];
+    u8_t   sect_run_cnt;
+#endif
 };
 
 /**
@@ -138,10 +210,86 @@ int zb_slt_area_get(struct zb_slt_area *area, u8_t slt_idx);
  */
 bool zb_in_slt_area(struct zb_slt_area *area, u8_t slt, off_t address);
 
+/**
+ * @brief zb_sector_offset
+ *
+ * Returns the location (from the slot start) of sector sect of the slots in
+ * area. With CONFIG_FLASH_PAGE_LAYOUT the sectors follow the erase pages of
+ * slot 0 and slot 1: a sector is the smallest group of complete erase pages
+ * (in both slots) of at least SECTOR_SIZE, they are taken from the sector map
+ * of area. Without it all sectors are SECTOR_SIZE.
+ *
+ * @param fs Pointer to zb_slt_area
+ * @param sect sector index
+ * @param size Pointer to the sector size (can be NULL)
+ * @retval offset of the sector from the slot start
+ */
+off_t zb_sector_offset(struct zb_slt_area *area, u8_t sect, size_t *size);
+
+/**
+ * @brief zb_sector_cnt
+ *
+ * Returns the number of sectors used by len bytes from the slot start.
+ *
+ * @param fs Pointer to zb_slt_area
+ * @param len length from the slot start
+ * @retval number of sectors
+ */
+int zb_sector_cnt(struct zb_slt_area *area, size_t len);
+
+/**
+ * @brief zb_sector_last
+ *
+ * Returns the size of the last sector of slt (slt0end or slt1end).
+ *
+ * @param fs Pointer to zb_slt_area
+ * @param slt 0 or 1
+ * @retval size of the last sector
+ */
+size_t zb_sector_last(struct zb_slt_area *area, u8_t slt);
+
+/**
+ * @brief zb_sector_uniform
+ *
+ * Checks if all sectors of the slots in area are SECTOR_SIZE. Compressed
+ * images, sector hashes and scratch sectors require uniform sectors.
+ *
+ * @param fs Pointer to zb_slt_area
+ * @retval true if all sectors are SECTOR_SIZE
+ */
+bool zb_sector_uniform(struct zb_slt_area *area);
+
+/**
+ * @brief zb_scratch_offset
+ *
+ * Returns the location of the scratch sector that is used for image sector
+ * sect (only valid when area->scratch_cnt > 0). The rotation starts at the
+ * scratch sector after the one used last by the previous upgrade.
+ *
+ * @param fs Pointer to zb_slt_area
+ * @param start scratch rotation start of the upgrade
+ * @param sect image sector
+ * @retval offset of the scratch sector
+ */
+off_t zb_scratch_offset(struct zb_slt_area *area, u32_t start, u32_t sect);
+
+/**
+ * @brief zb_scratch_start
+ *
+ * Returns the scratch rotation start of the next upgrade (the number of
+ * scratch uses of the previous upgrades kept in zb_prm, 0 when there is no
+ * zb_prm). A swap keeps the start in its start command, it doesn't depend on
+ * the zb_prm that is replaced in phase 3.
+ *
+ * @param fs Pointer to zb_slt_area
+ * @retval scratch rotation start
+ */
+u32_t zb_scratch_start(struct zb_slt_area *area);
+
 /**
  * @brief zb_erase_swpstat
  *
- * Erases the swpstat area in zb_slt_area.
+ * Erases the swpstat area in zb_slt_area (except the scratch sectors).
  *
  * @param fs Pointer to zb_slt_area
  * @retval 0 Success
@@ -210,6 +358,18 @@ struct zb_cmd {
  */
 int zb_cmd_read_swpstat(struct zb_slt_area *area, struct zb_cmd *cmd);
 
+/**
+ * @brief zb_cmd_read_swpstat_first
+ *
+ * reads the first cmd from swpstat_area (the cmd that started the swap)
+ *
+ * @param area Pointer to zb_slt_area
+ * @param cmd Pointer to command
+ * @retval 0 Success
+ * @retval -ERRNO errno code if error
+ */
+int zb_cmd_read_swpstat_first(struct zb_slt_area *area, struct zb_cmd *cmd);
+
 /**
  * @brief zb_cmd_read_slt0end
  *
@@ -270,6 +430,69 @@ int zb_cmd_write_slt0end(struct zb_slt_area *area, struct zb_cmd *cmd);
  */
 int zb_cmd_write_slt1end(struct zb_slt_area *area, struct zb_cmd *cmd);
 
+/**
+ * @}
+ */
+
+/**
+ * @brief zb_idle: summary of the command state in a slot area
+ *
+ * When the bootloader finds nothing to do in a slot area it writes a zb_idle
+ * record to the last write block of the swap status area. The record stores
+ * how many commands were found in slt1end and a copy of the last of these.
+ * On the next boot the record together with the slt1end entry at position cnt
+ * (and cnt - 1) is enough to decide that no new command has been written, so
+ * scanning the command logs can be skipped.
+ *
+ * The record is invalidated by erasing the swap status area, which is done at
+ * the start of each swap.
+ * @{
+ */
+
+struct zb_idle {
+	/*@{*/
+	struct zb_cmd last; /**< last (raw) entry in slt1end */
+	u16_t cnt;	    /**< number of entries in slt1end */
+	u8_t cmd1;	    /**< cmd1 of last valid entry in slt1end */
+	u8_t crc8;	    /**< crc8 calculated over the record */
+	/*@}*/
+} __packed;
+
+/**
+ * @}
+ */
+
+/**
+ * @brief zb_idle API
+ * @{
+ */
+
+/**
+ * @brief zb_idle_read
+ *
+ * reads the idle record from swpstat_area and checks that slt1end has not
+ * been changed since it was written
+ *
+ * @param area Pointer to zb_slt_area
+ * @param idle Pointer to idle record
+ * @retval 0 Success: nothing is pending in the slot area
+ * @retval -ENOENT no valid idle record or slt1end has been changed
+ * @retval -ERRNO errno code if error
+ */
+int zb_idle_read(struct zb_slt_area *area, struct zb_idle *idle);
+
+/**
+ * @brief zb_idle_write
+ *
+ * writes a new idle record for the current slt1end content to swpstat_area,
+ * this erases the swpstat_area when it contains an outdated idle record
+ *
+ * @param area Pointer to zb_slt_area
+ * @retval 0 Success
+ * @retval -ERRNO errno code if error
+ */
+int zb_idle_write(struct zb_slt_area *area);
+
 /**
  * @}
  */
@@ -279,6 +502,16 @@ int zb_cmd_write_slt1end(struct zb_slt_area *area, struct zb_cmd *cmd);
  * @{
  */
 
+#define ZB_PRM_VERSION 1
+
+/* prm image flags */
+#define ZB_PRM_FLAG_ENC 0x01 /* image is stored encrypted */
+#define ZB_PRM_FLAG_SEG 0x02 /* image has a segment table */
+
+/* The first part of zb_prm is the same for all versions, the image location
+ * fields are only valid when prm_ver equals ZB_PRM_VERSION. They allow booting
+ * without parsing (and decrypting) the image tlv area.
+ */
 struct zb_prm {
 	/*@{*/
 	off_t pri_ld_address; /**< primary load address */
@@ -287,7 +520,18 @@ struct zb_prm {
 	u32_t slt1_crc32; /**< crc32 calculated over signature in slt1 */
     u32_t slt0_ver; /**< version of image in slt0 */
     u32_t slt1_ver; /**< version of image in slt1 */
-
+	u32_t prm_ver; /**< version of the prm layout (ZB_PRM_VERSION) */
+	off_t slt0_start; /**< start of image in slt0 */
+	size_t slt0_size; /**< size of image in slt0 */
+	off_t slt0_vt_address; /**< vector table address of image in slt0 */
+	off_t slt1_start; /**< start of image in slt1 */
+	size_t slt1_size; /**< size of image in slt1 */
+	off_t slt1_vt_address; /**< vector table address of image in slt1 */
+	u32_t slt0_flags; /**< ZB_PRM_FLAG_* of image in slt0 */
+	u32_t slt1_flags; /**< ZB_PRM_FLAG_* of image in slt1 */
+	off_t slt0_seg_offset; /**< segment table tlv entry of image in slt0 */
+	off_t slt1_seg_offset; /**< segment table tlv entry of image in slt1 */
+	u32_t scr_start; /**< scratch rotation start of the next upgrade */
 	/*@}*/
 } __packed;
 
@@ -324,6 +568,46 @@ int zb_prm_read(struct zb_slt_area *area, struct zb_prm *prm);
  */
 int zb_prm_write(struct zb_slt_area *area, struct zb_prm *prm);
 
+/**
+ * @brief zb_crc_tbl API: per sector crc32 of the images, stored after the prm
+ * in slt0end. Entry sect covers the image bytes from image start +
+ * sect * SECTOR_SIZE up to the next sector or the image end.
+ * @{
+ */
+
+/**
+ * @brief zb_crc_tbl_read
+ *
+ * reads the crc32 of a image sector from slt0end_area
+ *
+ * @param area Pointer to zb_slt_area
+ * @param slt slot 0 or 1
+ * @param sect image sector
+ * @param crc32 Pointer to crc32
+ * @retval 0 Success
+ * @retval -ENOENT no crc32 stored for sector
+ * @retval -ENOSPC no crc table available in slt0end_area
+ * @retval -ERRNO errno code if error
+ */
+int zb_crc_tbl_read(struct zb_slt_area *area, u8_t slt, u32_t sect,
+		    u32_t *crc32);
+
+/**
+ * @brief zb_crc_tbl_write
+ *
+ * writes the crc32 of a image sector to slt0end_area
+ *
+ * @param area Pointer to zb_slt_area
+ * @param slt slot 0 or 1
+ * @param sect image sector
+ * @param crc32 crc32 of the image sector
+ * @retval 0 Success
+ * @retval -ENOSPC no crc table available in slt0end_area
+ * @retval -ERRNO errno code if error
+ */
+int zb_crc_tbl_write(struct zb_slt_area *area, u8_t slt, u32_t sect,
+		     u32_t crc32);
+
 /**
  * @}
  */
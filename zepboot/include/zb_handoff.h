@@ -0,0 +1,127 @@
+/*
+ * Bootloader to application handoff: the bootloader leaves information about
+ * the boot in a fixed RAM location, the application can read it using
+ * zb_handoff_get() without reading the flash.
+ *
+ * Copyright (c) 2019 Laczen
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef H_ZB_HANDOFF_
+#define H_ZB_HANDOFF_
+
+#include <sys/types.h>
+#include <crc.h>
+#include "zb_flash.h"
+#include "zb_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZB_HANDOFF_MAGIC 0x5a42484f /* ZBHO in hex */
+#define ZB_HANDOFF_VERSION 1
+
+/* The handoff record is placed at the end of RAM, both the bootloader and the
+ * application need to keep this region free (e.g. by reducing the sram size
+ * in the application dts overlay).
+ */
+#ifndef ZB_HANDOFF_ADDRESS
+#define ZB_HANDOFF_ADDRESS (DT_SRAM_BASE_ADDRESS + DT_SRAM_SIZE * 1024 - \
+			    sizeof(struct zb_handoff))
+#endif
+
+/**
+ * @brief zb_handoff_img: image info of the booted image (as zb_img_info but
+ * without the encryption key and flash device)
+ * @{
+ */
+
+struct zb_handoff_img {
+	/*@{*/
+	off_t hdr_start;    /**< start of the image header */
+	off_t start;	    /**< start of the image */
+	off_t end;	    /**< end of the image */
+	u32_t load_address; /**< load address of the image */
+	img_ver version;    /**< version of the image */
+	u8_t type;	    /**< type of the image */
+	/*@}*/
+} __packed;
+
+/**
+ * @}
+ */
+
+/**
+ * @brief zb_handoff: information left by the bootloader
+ * @{
+ */
+
+struct zb_handoff {
+	/*@{*/
+	u32_t magic;		    /**< ZB_HANDOFF_MAGIC */
+	u16_t version;		    /**< ZB_HANDOFF_VERSION */
+	u8_t slt;		    /**< booted slot (0 or 1) */
+	u8_t swp_err;		    /**< swap returned an error */
+	u32_t swp_mask;		    /**< slot areas swapped during this boot */
+	u32_t swp_defer;	    /**< slot areas with a swap left for a
+				     *   later boot (budget spent)
+				     */
+	u32_t swp_ms;		    /**< time spent swapping (ms) */
+	u32_t boot_ms;		    /**< time from reset until boot (ms) */
+	struct zb_handoff_img img;  /**< info of the booted image */
+	struct zb_prm prm;	    /**< parameters of slot_map[0] */
+	u32_t crc32;		    /**< crc32 calculated over the record */
+	/*@}*/
+} __packed;
+
+/**
+ * @}
+ */
+
+/**
+ * @brief zb_handoff API
+ * @{
+ */
+
+/**
+ * @brief zb_handoff_write
+ *
+ * used by the bootloader to fill and seal the handoff record
+ *
+ * @param ho Pointer to handoff record (filled except for magic, version and
+ *	     crc32)
+ * @param info image info of the booted image
+ */
+void zb_handoff_write(struct zb_handoff *ho, zb_img_info *info);
+
+/**
+ * @brief zb_handoff_get
+ *
+ * used by the application to get the handoff record
+ *
+ * @retval Pointer to the handoff record, NULL if there is no valid record
+ */
+static inline const struct zb_handoff *zb_handoff_get(void)
+{
+	const struct zb_handoff *ho;
+
+	ho = (const struct zb_handoff *)ZB_HANDOFF_ADDRESS;
+	if ((ho->magic != ZB_HANDOFF_MAGIC) ||
+	    (ho->version != ZB_HANDOFF_VERSION) ||
+	    (ho->crc32 != crc32_ieee((const u8_t *)ho,
+				     offsetof(struct zb_handoff, crc32)))) {
+		return NULL;
+	}
+	return ho;
+}
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,6 +10,8 @@
 #include <device.h>
 #include "zb_flash.h"
 #include "zb_aes.h"
+#include "zb_chacha.h"
+#include "zb_ec256.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,12 +39,104 @@ typedef struct __packed {
 #define TLVE_IMAGE_INFO 0x20
 #define TLVE_IMAGE_INFO_BYTES sizeof(zb_tlv_img_info)
 
+/* optional segment table of a image that is started from flash: each entry
+ * describes a part of the image (offset from the image start) and where it
+ * is placed in RAM before the image is started. Segments with SEG_FLAG_LOAD
+ * are copied, segments with SEG_FLAG_ZERO are cleared (they have no image
+ * data), other segments are only listed for the application.
+ */
+typedef struct __packed {
+    u32_t   offset; /* offset from the image start */
+    u32_t   size;
+    u32_t   load_address;
+    u32_t   flags;
+} zb_tlv_img_seg;
+
+#define TLVE_IMAGE_SEG 0x21
+#define TLVE_IMAGE_SEG_BYTES sizeof(zb_tlv_img_seg) /* per entry */
+
+#define SEG_FLAG_LOAD 0x01
+#define SEG_FLAG_ZERO 0x02
+
+/* maximum number of segments kept in zb_img_info */
+#ifndef IMG_SEG_MAX
+#define IMG_SEG_MAX 4
+#endif
+
 #define TLVE_IMAGE_HASH 0x30
 #define TLVE_IMAGE_HASH_BYTES HASH_BYTES
 
+/* optional hash of the unencrypted image */
+#define TLVE_IMAGE_PHASH 0x31
+#define TLVE_IMAGE_PHASH_BYTES HASH_BYTES
+
+/* optional per sector hash table: the table of sector hashes is placed after
+ * the image (aligned), the tlv contains the sector size and the hash of the
+ * table. Each table entry is the hash of the image data in a sector (starting
+ * from the image header).
+ */
+typedef struct __packed {
+    u32_t   sect_size;
+    u8_t    root[HASH_BYTES]; /* hash of the sector hash table */
+} zb_tlv_sect_hash;
+
+#define TLVE_IMAGE_SECT_HASH 0x32
+#define TLVE_IMAGE_SECT_HASH_BYTES sizeof(zb_tlv_sect_hash)
+
+/* optional hash type of the image hashes (HASH_TYPE_SHA256 or
+ * HASH_TYPE_BLAKE2S), the default is HASH_TYPE_SHA256
+ */
+#define TLVE_IMAGE_HASH_TYPE 0x33
+#define TLVE_IMAGE_HASH_TYPE_BYTES 1
+
 #define TLVE_IMAGE_EPUBKEY 0x40
 #define TLVE_IMAGE_EPUBKEY_BYTES PUBLIC_KEY_BYTES
 
+/* optional cipher of encrypted images (ENC_TYPE_AES128_CTR or
+ * ENC_TYPE_CHACHA20), the default is ENC_TYPE_AES128_CTR
+ */
+#define TLVE_IMAGE_ENC_TYPE 0x41
+#define TLVE_IMAGE_ENC_TYPE_BYTES 1
+
+#define ENC_TYPE_AES128_CTR 0x00
+#define ENC_TYPE_CHACHA20 0x01
+
+/* encryption key storage, large enough for all ciphers */
+#define ENC_KEY_BYTES CHACHA20_KEY_BYTES
+
+/* optional compressed image: the image is stored in slot 1 as a compressed
+ * stream, it is expanded to slot 0 during the swap (after decryption). The
+ * stream consists of lz4 type sequences (token, literals, offset, match), a
+ * sequence never crosses a sector boundary of the expanded image and the
+ * sequence that ends a sector has no offset and match. Matches can refer to
+ * all data in the previous sectors (up to 64kB back). A table with the stream
+ * offset where each sector starts (u32_t, sector 0 starts at 0) is placed
+ * after the stream (aligned). The image hash is calculated over the stream
+ * and the table.
+ */
+typedef struct __packed {
+    u32_t   start; /* offset of the stream from the tlv area start */
+    u32_t   size;  /* size of the stream */
+    u32_t   sect_size; /* sector size of the expanded image */
+} zb_tlv_img_cmp;
+
+#define TLVE_IMAGE_CMP 0x60
+#define TLVE_IMAGE_CMP_BYTES sizeof(zb_tlv_img_cmp)
+
+/* optional delta image: a compressed image where a match with offset 0 is
+ * followed by a u32_t (little endian) offset in the base image, the match
+ * data is copied from the base image (the image in slot 0). The base image is
+ * identified by the version and crc32 that are kept for slot 0 in the prm
+ * area, a delta image is only swapped when these are equal.
+ */
+typedef struct __packed {
+    u32_t   version; /* version of the base image (zb_img_conv_version_u32) */
+    u32_t   crc32; /* crc32 of the base image */
+} zb_tlv_img_delta;
+
+#define TLVE_IMAGE_DELTA 0x61
+#define TLVE_IMAGE_DELTA_BYTES sizeof(zb_tlv_img_delta)
+
 /** @brief image API structures
  * @{
  */
@@ -57,7 +151,24 @@ typedef struct {
     off_t end;
     u32_t load_address;
     img_ver version;
-    u8_t enc_key[AES_BLOCK_SIZE];
+    u8_t enc_key[ENC_KEY_BYTES];
+    u8_t enc_type; /* cipher of the encrypted image */
+    u8_t phash[HASH_BYTES]; /* hash of the unencrypted image */
+    bool has_phash;
+    u8_t sect_root[HASH_BYTES]; /* hash of the sector hash table */
+    bool has_sect_hash;
+    u8_t hash_type; /* hash type of the image hashes */
+    bool has_cmp; /* image has a compressed form */
+    bool is_cmp; /* image is stored compressed */
+    off_t cmp_start; /* start of the compressed stream */
+    off_t cmp_end; /* end of the compressed stream */
+    bool is_delta; /* image is stored as a delta to the base image */
+    u32_t base_ver; /* version of the base image */
+    u32_t base_crc32; /* crc32 of the base image */
+    bool is_predec; /* decrypted in slot 1 by the application */
+    zb_tlv_img_seg seg[IMG_SEG_MAX]; /* segment table */
+    u8_t seg_cnt;
+    off_t seg_offset; /* location of the segment table tlv entry */
     u8_t type;
     struct device *flash_device;
     bool is_valid;
@@ -97,11 +208,77 @@ void zb_img_get_info_nsc(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
  * @param slt_idx slot_area index
  * @param slt slot 0 or 1
  * @param eoff extra offset (used in case the image is in a shifted position)
- * @param val_img validate image (check hash)
+ * @param val_img validate image (check hash), for images with a sector hash
+ *                table only the table is checked
  */
 void zb_img_get_info_wsc(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
                          off_t eoff, bool val_img);
 
+/**
+ * @brief zb_img_get_info_prm
+ *
+ * gets the image info from the parameters stored after a swap instead of from
+ * the tlv area. The returned info has no encryption key, the image is reported
+ * as unencrypted. The version has no build number. The segment table is read
+ * from its recorded location in the tlv area.
+ *
+ * @param img_info pointer to store info in, if it is valid image info the
+ *                 img_info.is_valid flag is set
+ * @param area slot_area
+ * @param prm parameters read from slot_area
+ * @param slt slot 0 or 1
+ * @retval 0 Success
+ * @retval -ENOENT prm does not contain image info (or for the slot)
+ * @retval -EFAULT bad segment table
+ */
+int zb_img_get_info_prm(zb_img_info *info, struct zb_slt_area *area,
+			struct zb_prm *prm, u8_t slt);
+
+/**
+ * @brief zb_img_check_sect_tbl
+ *
+ * checks the sector hash table of a image against the hash in the tlv area
+ *
+ * @param info image info (with sector hash table)
+ * @param eoff extra offset (used in case the image is in a shifted position)
+ * @retval 0 Success
+ * @retval -EFAULT table does not match
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_check_sect_tbl(zb_img_info *info, off_t eoff);
+
+/**
+ * @brief zb_img_check_sect
+ *
+ * checks the image data of a sector against the sector hash table, the table
+ * is read from its location after the image.
+ *
+ * @param info image info (with sector hash table)
+ * @param off location of the sector data (can differ from the image location
+ *	      when the sector has been moved)
+ * @param sect sector
+ * @retval 0 Success
+ * @retval -EFAULT sector data does not match
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_check_sect(zb_img_info *info, off_t off, u8_t sect);
+
+/**
+ * @brief zb_img_cmp_restart
+ *
+ * gets the location in the compressed stream where the data of a sector of
+ * the expanded image starts, the table is read from its location after the
+ * stream.
+ *
+ * @param info image info (of a compressed image)
+ * @param sect sector
+ * @param off return location of the sector data in the stream
+ * @retval 0 Success
+ * @retval -EFAULT table entry is not inside the stream
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_cmp_restart(zb_img_info *info, u8_t sect, off_t *off);
+
 /**
  * @brief zb_img_calc_crc32
  *
@@ -114,6 +291,35 @@ void zb_img_get_info_wsc(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
  */
 int zb_img_calc_crc32(zb_img_info *info, u32_t *crc32);
 
+/**
+ * @brief zb_img_calc_crc32_tbl
+ *
+ * calculates the crc32 over the image and writes the crc32 of each image
+ * sector to the crc table in slt0end (see zb_crc_tbl_write)
+ *
+ * @param area slot_area that contains the image
+ * @param img_info image info this needs to be set first
+ * @param slt slot of the image (0 or 1)
+ * @param crc32 calculated crc
+ * @retval 0 Success
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_calc_crc32_tbl(struct zb_slt_area *area, zb_img_info *info,
+			  u8_t slt, u32_t *crc32);
+
+/**
+ * @brief zb_img_calc_sect_crc32
+ *
+ * calculates the crc32 over one sector of the image
+ *
+ * @param img_info image info this needs to be set first
+ * @param sect image sector
+ * @param crc32 calculated crc
+ * @retval 0 Success
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_calc_sect_crc32(zb_img_info *info, u32_t sect, u32_t *crc32);
+
 /**
  * @brief zb_img_conv_version_u32
  *
@@ -124,6 +330,16 @@ int zb_img_calc_crc32(zb_img_info *info, u32_t *crc32);
  */
 void zb_img_conv_version_u32(img_ver *ver, u32_t *u32_ver);
 
+/**
+ * @brief zb_img_conv_u32_version
+ *
+ * convert u32 format version to image version, build number is set to 0
+ *
+ * @param[in] u32 format of version
+ * @param[out] version
+ */
+void zb_img_conv_u32_version(u32_t u32_ver, img_ver *ver);
+
 /**
  * @brief zb_img_check
  *
@@ -28,6 +28,8 @@ extern "C" {
 #define CMD1_MASK_SWP_PERM	0b00000001
 #define CMD1_MASK_SWP_REQUEST	0b00010000 /* swap request */
 #define CMD1_MASK_BT0_REQUEST	0b00100000 /* boot slot 0 request */
+#define CMD1_MASK_SECT_ERR	0b01000000 /* sector hash mismatch or bad
+					    * compressed data in swap */
 
 /* cmd2 definitions */
 
@@ -51,7 +53,48 @@ extern "C" {
 					    * a. Erase last fr sector
 					    * b. Write info to last fr sector
 					    */
+#define CMD2_SCR_P1		0b00011010 /* Scratch phase 1 (inplace):
+					    * a. Erase scratch sector,
+					    * b. Copy fr sect x -> scratch
+					    */
+#define CMD2_SCR_P2		0b00011011 /* Scratch phase 2 (inplace):
+					    * a. Erase fr sect x,
+					    * b. Decrypt scratch -> fr sect x
+					    */
 #define CMD2_SWP_END		0b00011111
+#define CMD2_PDC_P1		0b01010000 /* Pre-decryption phase 1 (app):
+					    * a. Erase scratch sector,
+					    * b. Copy slt1 sect x -> scratch
+					    */
+#define CMD2_PDC_P2		0b01010001 /* Pre-decryption phase 2 (app):
+					    * a. Erase slt1 sect x,
+					    * b. Decrypt scratch -> slt1 sect x
+					    */
+#define CMD2_PDC_END		0b01010010
+
+/**
+ * @brief zb_crc_acc: crc32 (and optionally hash) of an image accumulated while
+ * it is moved to its destination slot, this avoids reading the image again to
+ * calculate the crc32 (or hash) after the swap
+ * @{
+ */
+
+typedef struct {
+	off_t start;	  /* start of the image in the destination */
+	off_t end;	  /* end of the image in the destination */
+	off_t off;	  /* next destination offset to accumulate */
+	u32_t crc32;	  /* crc32 from start to off */
+	u32_t sect_crc32; /* crc32 of the current (image) sector */
+	u32_t *tbl;	  /* per sector crc32, NULL if not kept */
+	u8_t sect;	  /* current (image) sector */
+	bool valid;	  /* all data from start to off has been seen */
+	bool hash;	  /* also calculate the image hash */
+	struct zb_hash_ctx hctx;
+} zb_crc_acc;
+
+/**
+ * @}
+ */
 
 /**
  * @brief zb_move_cmd: necessary info to do a move of a sector or a move from
@@ -68,8 +111,11 @@ typedef struct {
 			   image start */
 	off_t to_off;	/* offset of sector to move to */
 	u8_t *key;	/* pointer to encryption key */
+	u8_t enc_type;	/* cipher used with key */
+	u8_t mark;	/* TLVA_TYPE bits to set in the moved tlv area header */
 	struct device *fl_dev_fr;
 	struct device *fl_dev_to;
+	zb_crc_acc *acc; /* crc32 accumulator of destination, NULL if unused */
 } zb_move_cmd;
 
 /**
@@ -85,8 +131,30 @@ typedef struct {
 	zb_img_info to;	/* information about image in the to area */
 	zb_img_info fr;	/* information about image in the from area */
 	bool loaded;	/* has the information been loaded ? */
+	zb_crc_acc crc[2]; /* crc32 of the images in slt0 and slt1 after swap */
+	bool sect_err;	/* sector hash table of the from image is invalid */
+	u32_t scr_start; /* scratch rotation start of this upgrade */
 } zb_img_swp_info;
 
+/**
+ * @}
+ */
+
+/**
+ * @brief zb_img_swp_step: state of a swap that is done in steps, each step does
+ * at most one sector erase and the writes that follow it
+ * @{
+ */
+
+typedef struct {
+	zb_img_swp_info info;
+	u8_t phase;	/* next step (cmd2), CMD2_SWP_END when done */
+	u8_t sect;	/* sector of the next step */
+	u16_t done;	/* steps done */
+	u16_t remaining; /* steps remaining (estimate) */
+	bool rejected;	/* installed image rejected, restored after swap */
+} zb_img_swp_step;
+
 /**
  * @}
  */
@@ -107,6 +175,50 @@ typedef struct {
  */
 int zb_img_swap(struct zb_slt_area *area);
 
+/**
+ * @brief zb_img_swap_stat
+ *
+ * Same as zb_img_swap, also reports if a swap has been done
+ *
+ * @param[in] area Pointer to zb_slt_area that contains the images to be swapped
+ * @param[out] swapped true if a swap was started or continued
+ * @retval 0 Success
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_swap_stat(struct zb_slt_area *area, bool *swapped);
+
+/**
+ * @brief zb_img_swap_begin
+ *
+ * Checks if a swap has to be started or continued in the specified area. The
+ * swap is then done by calling zb_img_swap_step until it no longer returns
+ * -EAGAIN, e.g. with a watchdog feed between the steps. A swap that is
+ * interrupted continues on the next zb_img_swap_begin.
+ *
+ * @param[in] area Pointer to zb_slt_area that contains the images to be swapped
+ * @param[out] step Pointer to zb_img_swp_step, phase is CMD2_SWP_END when there
+ * is nothing to do
+ * @retval 0 Success
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_swap_begin(struct zb_slt_area *area, zb_img_swp_step *step);
+
+/**
+ * @brief zb_img_swap_step
+ *
+ * Does the next step of a swap started by zb_img_swap_begin and updates the
+ * progress (phase, sect, done and remaining). When the installed image is
+ * rejected the restore of the previous image is started and continued by the
+ * next steps.
+ *
+ * @param[in] area Pointer to zb_slt_area that contains the images to be swapped
+ * @param[in,out] step Pointer to zb_img_swp_step
+ * @retval 0 Swap done
+ * @retval -EAGAIN more steps are needed
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_swap_step(struct zb_slt_area *area, zb_img_swp_step *step);
+
 /**
  * @brief zb_img_ram_move
  *
@@ -119,6 +231,51 @@ int zb_img_swap(struct zb_slt_area *area);
  */
 int zb_img_ram_move(zb_img_info *info);
 
+/**
+ * @brief zb_img_ram_load
+ *
+ * Moves a image to RAM and checks the crc32 of the image in the same pass (the
+ * image is read from flash only once). Encrypted images are decrypted while
+ * they are moved, the crc32 is calculated over the encrypted data in flash.
+ * On a crc32 mismatch the RAM copy is cleared.
+ *
+ * @param[in] info Pointer to zb_img_info that contains the required info about
+ * the image to be moved to RAM
+ * @param[in] crc32 expected crc32 of the image
+ * @retval 0 Success
+ * @retval -EFAULT crc32 mismatch
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_ram_load(zb_img_info *info, u32_t crc32);
+
+/**
+ * @brief zb_img_ram_verify
+ *
+ * Checks if the image is still present in RAM (e.g. after a warm reset)
+ *
+ * @param[in] info Pointer to zb_img_info that contains the required info about
+ * the image that was moved to RAM
+ * @param[in] crc32 crc32 of the image
+ * @retval 0 Success: RAM contains the image
+ * @retval -EFAULT RAM content differs
+ */
+int zb_img_ram_verify(zb_img_info *info, u32_t crc32);
+
+/**
+ * @brief zb_img_seg_load
+ *
+ * Places the segments of a image that is started from flash in RAM: segments
+ * with SEG_FLAG_LOAD are copied from the image, segments with SEG_FLAG_ZERO
+ * are cleared. Only the segments are copied, the rest of the image is
+ * executed in place.
+ *
+ * @param[in] info Pointer to zb_img_info of the (verified) image in flash
+ * @retval 0 Success
+ * @retval -EFAULT segment outside RAM
+ * @retval -ERRNO errno code if error
+ */
+int zb_img_seg_load(zb_img_info *info);
+
 /**
  * @}
  */
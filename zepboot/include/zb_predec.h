@@ -0,0 +1,91 @@
+/*
+ * Application side pre-decryption of the image in slot 1: a running
+ * application decrypts a downloaded (encrypted) image in place, in small steps
+ * that can be run from a low priority thread. The bootloader then moves the
+ * image without decryption when the swap is done.
+ *
+ * Copyright (c) 2019 Laczen
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef H_ZB_PREDEC_
+#define H_ZB_PREDEC_
+
+#include <sys/types.h>
+#include "zb_flash.h"
+#include "zb_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief zb_predec: state of the pre-decryption of a slot 1 image
+ * @{
+ */
+
+struct zb_predec {
+	/*@{*/
+	struct zb_slt_area *area; /**< area that contains the image */
+	zb_img_info info;	  /**< image in slot 1 */
+	struct zb_cmd cmd;	  /**< last progress command */
+	u8_t sect_cnt;		  /**< sectors used by the image */
+	u32_t scr_start;	  /**< scratch rotation start */
+	/*@}*/
+};
+
+/**
+ * @}
+ */
+
+/**
+ * @brief zb_predec API
+ * @{
+ */
+
+/**
+ * @brief zb_predec_init
+ *
+ * Prepares the pre-decryption of the image in slot 1 of area, or continues a
+ * pre-decryption that was interrupted (the progress is kept in the commands at
+ * the end of slot 1). A new pre-decryption is only started for a image that
+ * passes the same checks as a swap (signature and image hash) and that has a
+ * hash of the unencrypted image (imgtool -ph): the bootloader uses this hash to
+ * check the image after pre-decryption. The area needs scratch sectors.
+ *
+ * When a new image is written to slot 1 the end of slot 1 has to be erased
+ * (zb_erase_slt1end) before the pre-decryption is started.
+ *
+ * @param[out] pdc Pointer to zb_predec
+ * @param[in] area Pointer to zb_slt_area that contains the image
+ * @retval 0 Success
+ * @retval -EFAULT bad image
+ * @retval -ENOTSUP image or area not suited for pre-decryption
+ * @retval -ENOSPC not enough room to track the progress
+ * @retval -ERRNO errno code if error
+ */
+int zb_predec_init(struct zb_predec *pdc, struct zb_slt_area *area);
+
+/**
+ * @brief zb_predec_step
+ *
+ * Does the next step of the pre-decryption, each step copies or decrypts one
+ * sector. A swap can be requested once the pre-decryption is done, any pending
+ * swap request is removed when the pre-decryption is started.
+ *
+ * @param[in] pdc Pointer to zb_predec (from zb_predec_init)
+ * @retval 0 Pre-decryption done
+ * @retval -EAGAIN more steps are needed
+ * @retval -ERRNO errno code if error
+ */
+int zb_predec_step(struct zb_predec *pdc);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2019 Laczen
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef H_ZB_RET_
+#define H_ZB_RET_
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZB_RET_MAGIC 0x5a425254 /* ZBRT in hex */
+
+/**
+ * @brief zb_ret: boot information kept in retained (noinit) RAM
+ *
+ * The bootloader writes the boot address and crc32 of the booted image to a
+ * zb_ret block in RAM that is not initialized at startup. The block is sealed
+ * with a crc32. On a warm reset the block is still valid and the bootloader
+ * can skip the verification of the image (and for RAM images the copy to RAM).
+ * After a power on the RAM content is random and the seal check fails.
+ * @{
+ */
+
+struct zb_ret {
+	/*@{*/
+	u32_t magic;		/**< ZB_RET_MAGIC */
+	off_t boot_address;	/**< address the image was booted from */
+	u32_t img_crc32;	/**< crc32 of the booted image */
+	u32_t vfy_sect;		/**< next sector of the rotating verification */
+	u32_t crc32;		/**< crc32 calculated over the block */
+	/*@}*/
+} __packed;
+
+/**
+ * @}
+ */
+
+/**
+ * @brief zb_ret API
+ * @{
+ */
+
+/**
+ * @brief zb_ret_read
+ *
+ * checks the magic and the seal of a retained block
+ *
+ * @param ret Pointer to retained block
+ * @retval 0 Success
+ * @retval -ENOENT block is not valid
+ */
+int zb_ret_read(struct zb_ret *ret);
+
+/**
+ * @brief zb_ret_write
+ *
+ * fills and seals a retained block
+ *
+ * @param ret Pointer to retained block
+ * @param boot_address address the image is booted from
+ * @param img_crc32 crc32 of the booted image
+ * @param vfy_sect next sector of the rotating verification
+ */
+void zb_ret_write(struct zb_ret *ret, off_t boot_address, u32_t img_crc32,
+		  u32_t vfy_sect);
+
+/**
+ * @brief zb_ret_clear
+ *
+ * invalidates a retained block
+ *
+ * @param ret Pointer to retained block
+ */
+void zb_ret_clear(struct zb_ret *ret);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
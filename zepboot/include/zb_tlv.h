@@ -19,6 +19,22 @@ extern "C" {
 
 #define TLV_AREA_SIGN_SIZE SIGNATURE_BYTES
 
+/* Signature types: ec_dsa 256 (default) or ed25519, both signatures are
+ * calculated over the hash (SHA256) of the tlv entries.
+ */
+#define TLVA_SIG_TYPE_EC256 0x00
+#define TLVA_SIG_TYPE_ED25519 0x01
+
+/* tlv area header types (bits): a compressed image (TLVE_IMAGE_CMP) that has
+ * been moved to slot 1 by a swap is stored expanded, the bootloader marks this
+ * in the (unsigned) tlv area header.
+ */
+#define TLVA_TYPE_EXPANDED 0x01
+/* a encrypted image that has been decrypted in slot 1 by the application
+ * (zb_predec), it is checked against the (signed) unencrypted image hash.
+ */
+#define TLVA_TYPE_DECRYPTED 0x02
+
 /* tlv (type length value) area header definition:
  *
  * A tlv area is defined as a header and a set of tlv entries.
@@ -39,6 +55,12 @@ typedef struct __packed {
 /* In a tlv area a entry has a type, a length and a value */
 /* A entry type of 0x00 is reserved for internal usage */
 
+/* Key id of the signing key (see zb_key_id()), when present only the root key
+ * with the same key id is used to verify the signature.
+ */
+#define TLVE_KEY_ID 0x50
+#define TLVE_KEY_ID_BYTES KEY_ID_BYTES
+
 typedef struct {
     u8_t type;
     u8_t length;
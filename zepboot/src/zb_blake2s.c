@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2019 LaczenJMS.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include "../include/zb_blake2s.h"
+
+static const u32_t blake2s_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const u8_t blake2s_sigma[10][16] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+	{14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+	{11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+	{ 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+	{ 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+	{ 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+	{12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+	{13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+	{ 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+	{10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0}
+};
+
+static u32_t ror32(u32_t x, int c)
+{
+	return (x >> c) | (x << (32 - c));
+}
+
+static void blake2s_g(u32_t *v, int a, int b, int c, int d, u32_t x, u32_t y)
+{
+	v[a] = v[a] + v[b] + x;
+	v[d] = ror32(v[d] ^ v[a], 16);
+	v[c] = v[c] + v[d];
+	v[b] = ror32(v[b] ^ v[c], 12);
+	v[a] = v[a] + v[b] + y;
+	v[d] = ror32(v[d] ^ v[a], 8);
+	v[c] = v[c] + v[d];
+	v[b] = ror32(v[b] ^ v[c], 7);
+}
+
+static void blake2s_compress(struct zb_blake2s_state *s, bool last)
+{
+	u32_t v[16], m[16];
+	const u8_t *sg;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		m[i] = s->buf[4 * i] | (s->buf[4 * i + 1] << 8) |
+		       (s->buf[4 * i + 2] << 16) |
+		       ((u32_t)s->buf[4 * i + 3] << 24);
+	}
+	for (i = 0; i < 8; i++) {
+		v[i] = s->h[i];
+		v[i + 8] = blake2s_iv[i];
+	}
+	v[12] ^= s->t[0];
+	v[13] ^= s->t[1];
+	if (last) {
+		v[14] = ~v[14];
+	}
+
+	for (i = 0; i < 10; i++) {
+		sg = blake2s_sigma[i];
+		blake2s_g(v, 0, 4, 8, 12, m[sg[0]], m[sg[1]]);
+		blake2s_g(v, 1, 5, 9, 13, m[sg[2]], m[sg[3]]);
+		blake2s_g(v, 2, 6, 10, 14, m[sg[4]], m[sg[5]]);
+		blake2s_g(v, 3, 7, 11, 15, m[sg[6]], m[sg[7]]);
+		blake2s_g(v, 0, 5, 10, 15, m[sg[8]], m[sg[9]]);
+		blake2s_g(v, 1, 6, 11, 12, m[sg[10]], m[sg[11]]);
+		blake2s_g(v, 2, 7, 8, 13, m[sg[12]], m[sg[13]]);
+		blake2s_g(v, 3, 4, 9, 14, m[sg[14]], m[sg[15]]);
+	}
+
+	for (i = 0; i < 8; i++) {
+		s->h[i] ^= v[i] ^ v[i + 8];
+	}
+}
+
+static void blake2s_count(struct zb_blake2s_state *s, u32_t len)
+{
+	s->t[0] += len;
+	if (s->t[0] < len) {
+		s->t[1]++;
+	}
+}
+
+void zb_blake2s_init(struct zb_blake2s_state *s)
+{
+	memcpy(s->h, blake2s_iv, sizeof(s->h));
+	/* no key, BLAKE2S_HASH_BYTES output */
+	s->h[0] ^= 0x01010000 ^ BLAKE2S_HASH_BYTES;
+	s->t[0] = 0;
+	s->t[1] = 0;
+	s->len = 0;
+}
+
+void zb_blake2s_update(struct zb_blake2s_state *s, const u8_t *data,
+		       size_t len)
+{
+	size_t cpy;
+
+	while (len) {
+		/* the last block is kept for zb_blake2s_final */
+		if (s->len == BLAKE2S_BLOCK_BYTES) {
+			blake2s_count(s, BLAKE2S_BLOCK_BYTES);
+			blake2s_compress(s, false);
+			s->len = 0;
+		}
+		cpy = MIN(len, BLAKE2S_BLOCK_BYTES - s->len);
+		memcpy(&s->buf[s->len], data, cpy);
+		s->len += cpy;
+		data += cpy;
+		len -= cpy;
+	}
+}
+
+void zb_blake2s_final(u8_t *hash, struct zb_blake2s_state *s)
+{
+	int i;
+
+	blake2s_count(s, s->len);
+	memset(&s->buf[s->len], 0, BLAKE2S_BLOCK_BYTES - s->len);
+	blake2s_compress(s, true);
+	for (i = 0; i < BLAKE2S_HASH_BYTES; i++) {
+		hash[i] = (s->h[i / 4] >> (8 * (i % 4))) & 0xff;
+	}
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2019 LaczenJMS.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr.h>
+#include <string.h>
+
+#include "../include/zb_chacha.h"
+
+#define ROTL32(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
+
+#define QROUND(x, a, b, c, d)				\
+	do {						\
+		x[a] += x[b]; x[d] = ROTL32(x[d] ^ x[a], 16); \
+		x[c] += x[d]; x[b] = ROTL32(x[b] ^ x[c], 12); \
+		x[a] += x[b]; x[d] = ROTL32(x[d] ^ x[a], 8);  \
+		x[c] += x[d]; x[b] = ROTL32(x[b] ^ x[c], 7);  \
+	} while (0)
+
+static u32_t ld32(const u8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32_t)p[3] << 24);
+}
+
+/* Generate the keystream block for the counter and advance the counter */
+static void chacha20_block(struct zb_chacha20_ctx *ctx)
+{
+	u32_t x[16];
+	int i;
+
+	memcpy(x, ctx->state, sizeof(x));
+	for (i = 0; i < 10; i++) {
+		QROUND(x, 0, 4, 8, 12);
+		QROUND(x, 1, 5, 9, 13);
+		QROUND(x, 2, 6, 10, 14);
+		QROUND(x, 3, 7, 11, 15);
+		QROUND(x, 0, 5, 10, 15);
+		QROUND(x, 1, 6, 11, 12);
+		QROUND(x, 2, 7, 8, 13);
+		QROUND(x, 3, 4, 9, 14);
+	}
+	for (i = 0; i < 16; i++) {
+		x[i] += ctx->state[i];
+		ctx->ks[4 * i] = x[i] & 0xff;
+		ctx->ks[4 * i + 1] = (x[i] >> 8) & 0xff;
+		ctx->ks[4 * i + 2] = (x[i] >> 16) & 0xff;
+		ctx->ks[4 * i + 3] = (x[i] >> 24) & 0xff;
+	}
+	ctx->state[12]++;
+	ctx->ks_off = 0;
+}
+
+void zb_chacha20_init(struct zb_chacha20_ctx *ctx, const u8_t *key,
+		      const u8_t *nonce)
+{
+	int i;
+
+	/* "expand 32-byte k" */
+	ctx->state[0] = 0x61707865;
+	ctx->state[1] = 0x3320646e;
+	ctx->state[2] = 0x79622d32;
+	ctx->state[3] = 0x6b206574;
+	for (i = 0; i < 8; i++) {
+		ctx->state[4 + i] = ld32(&key[4 * i]);
+	}
+	for (i = 0; i < 3; i++) {
+		ctx->state[13 + i] = nonce ? ld32(&nonce[4 * i]) : 0;
+	}
+	zb_chacha20_seek(ctx, 0);
+}
+
+void zb_chacha20_seek(struct zb_chacha20_ctx *ctx, u32_t offset)
+{
+	ctx->state[12] = offset / CHACHA20_BLOCK_BYTES;
+	ctx->ks_off = CHACHA20_BLOCK_BYTES;
+	if (offset % CHACHA20_BLOCK_BYTES) {
+		chacha20_block(ctx);
+		ctx->ks_off = offset % CHACHA20_BLOCK_BYTES;
+	}
+}
+
+void zb_chacha20_xor(struct zb_chacha20_ctx *ctx, u8_t *buf, size_t len)
+{
+	while (len--) {
+		if (ctx->ks_off == CHACHA20_BLOCK_BYTES) {
+			chacha20_block(ctx);
+		}
+		*buf++ ^= ctx->ks[ctx->ks_off++];
+	}
+}
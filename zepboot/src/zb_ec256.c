@@ -22,6 +22,22 @@ extern const unsigned int ec256_boot_pri_key_len;
 extern const char ec256_root_pub_key[];
 extern const unsigned int ec256_root_pub_key_len;
 
+/*
+ * The root public keys are validated by imgtool when keys.c is generated
+ * (geninclude fails on an invalid key). Set ROOT_KEY_VALIDATE to 1 to validate
+ * them again before each signature verification (e.g. for a keys.c that is not
+ * generated by imgtool).
+ */
+#ifndef ROOT_KEY_VALIDATE
+#define ROOT_KEY_VALIDATE 0
+#endif
+
+/* Called for each block in the flash hash and crc32 loops, the bootloader
+ * overrides it to feed the watchdog during the check of a large image.
+ */
+__weak void zb_wdt_feed(void)
+{
+}
 
 int zb_get_encr_key(u8_t *key, const u8_t *pubkey, u8_t keysize)
 {
@@ -72,18 +88,42 @@ int zb_get_encr_key(u8_t *key, const u8_t *pubkey, u8_t keysize)
 	return 0;
 }
 
-int zb_sign_verify(const u8_t *hash, const u8_t *signature)
+int zb_key_id(u8_t *key_id, const u8_t *pubkey, size_t len)
+{
+	struct tc_sha256_state_struct s;
+	u8_t digest[HASH_BYTES];
+
+	if ((!tc_sha256_init(&s)) ||
+	    (!tc_sha256_update(&s, pubkey, len)) ||
+	    (!tc_sha256_final(digest, &s))) {
+		return -EFAULT;
+	}
+	memcpy(key_id, digest, KEY_ID_BYTES);
+	return 0;
+}
+
+int zb_sign_verify_id(const u8_t *hash, const u8_t *signature,
+		      const u8_t *key_id)
 {
 	int cnt;
-	u8_t pubk[PUBLIC_KEY_BYTES];
+	const u8_t *pubk;
+	u8_t id[KEY_ID_BYTES];
 	const struct uECC_Curve_t * curve = uECC_secp256r1();
 
-	/* validate the hash for each of the root pubkeys */
+	/* validate the hash for each of the root pubkeys, when a key id is
+	 * given only the matching root pubkey(s) are tried.
+	 */
 	cnt = 0;
 	while (cnt < ec256_root_pub_key_len) {
-		memcpy(pubk, &ec256_root_pub_key[cnt], PUBLIC_KEY_BYTES);
+		pubk = (const u8_t *)&ec256_root_pub_key[cnt];
 		cnt += PUBLIC_KEY_BYTES;
-		if (uECC_valid_public_key(pubk, curve) != 0) {
+		if (key_id &&
+		    (zb_key_id(id, pubk, PUBLIC_KEY_BYTES) ||
+		     memcmp(id, key_id, KEY_ID_BYTES))) {
+			continue;
+		}
+		if (ROOT_KEY_VALIDATE &&
+		    (uECC_valid_public_key(pubk, curve) != 0)) {
 			continue;
 		}
 		if (uECC_verify(pubk, hash, VERIFY_BYTES, signature, curve)) {
@@ -93,17 +133,63 @@ int zb_sign_verify(const u8_t *hash, const u8_t *signature)
 	return -EFAULT;
 }
 
-int zb_hash_flash(u8_t *hash, struct device *fl_dev, off_t off, size_t len)
+int zb_sign_verify(const u8_t *hash, const u8_t *signature)
+{
+	return zb_sign_verify_id(hash, signature, NULL);
+}
+
+int zb_hash_init(struct zb_hash_ctx *ctx, u8_t type)
+{
+	ctx->type = type;
+	switch (type) {
+	case HASH_TYPE_SHA256:
+		return tc_sha256_init(&ctx->sha256) ? 0 : -EFAULT;
+	case HASH_TYPE_BLAKE2S:
+		zb_blake2s_init(&ctx->blake2s);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+int zb_hash_update(struct zb_hash_ctx *ctx, const u8_t *data, size_t len)
+{
+	switch (ctx->type) {
+	case HASH_TYPE_SHA256:
+		return tc_sha256_update(&ctx->sha256, data, len) ? 0 : -EFAULT;
+	case HASH_TYPE_BLAKE2S:
+		zb_blake2s_update(&ctx->blake2s, data, len);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+int zb_hash_final(u8_t *hash, struct zb_hash_ctx *ctx)
+{
+	switch (ctx->type) {
+	case HASH_TYPE_SHA256:
+		return tc_sha256_final(hash, &ctx->sha256) ? 0 : -EFAULT;
+	case HASH_TYPE_BLAKE2S:
+		zb_blake2s_final(hash, &ctx->blake2s);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+int zb_hash_flash_type(u8_t *hash, u8_t type, struct device *fl_dev, off_t off,
+		       size_t len)
 {
 	int rc;
-	struct tc_sha256_state_struct s;
+	struct zb_hash_ctx ctx;
 	u8_t buf[HASH_FLASH_BUFFER_BYTES]={0};
 	off_t start;
 	size_t jump;
 
-	rc = tc_sha256_init(&s);
-	if (!rc) {
-		return -EFAULT;
+	rc = zb_hash_init(&ctx, type);
+	if (rc) {
+		return rc;
 	}
 
 	start = zb_flash_align_offset(fl_dev, off);
@@ -111,28 +197,28 @@ int zb_hash_flash(u8_t *hash, struct device *fl_dev, off_t off, size_t len)
 	len += jump;
 	while (len > 0) {
 		size_t buf_len = MIN(HASH_FLASH_BUFFER_BYTES, len);
+
+		zb_wdt_feed();
 		rc = zb_flash_read(fl_dev, start, &buf, buf_len);
 		if (rc) {
-			goto end;
+			return rc;
 		}
 
-		rc = tc_sha256_update(&s, buf + jump, buf_len - jump);
-		if (!rc) {
-			rc = -EFAULT;
-			goto end;
+		rc = zb_hash_update(&ctx, buf + jump, buf_len - jump);
+		if (rc) {
+			return rc;
 		}
 		start += buf_len;
 		len -= buf_len;
 		jump = 0;
 	}
 
-	rc = tc_sha256_final(hash, &s);
-	if (rc) {
-		return 0;
-	}
-	return -EFAULT;
-end:
-	return rc;
+	return zb_hash_final(hash, &ctx);
+}
+
+int zb_hash_flash(u8_t *hash, struct device *fl_dev, off_t off, size_t len)
+{
+	return zb_hash_flash_type(hash, HASH_TYPE_SHA256, fl_dev, off, len);
 }
 
 int zb_crc32_flash(u32_t *crc32, struct device *fl_dev, off_t off, size_t len)
@@ -149,6 +235,7 @@ int zb_crc32_flash(u32_t *crc32, struct device *fl_dev, off_t off, size_t len)
 	while (len > 0) {
 		size_t buf_len = MIN(HASH_FLASH_BUFFER_BYTES, len);
 
+		zb_wdt_feed();
 		rc = zb_flash_read(fl_dev, start, &buf, buf_len);
 		if (rc) {
 			goto end;
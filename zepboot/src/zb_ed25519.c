@@ -0,0 +1,897 @@
+/*
+ * Copyright (c) 2019 LaczenJMS.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Ed25519 signature verification. The curve arithmetic follows the ref10
+ * implementation (public domain): field elements use 10 limbs in a s32_t, the
+ * verification is a double scalar multiplication with signed sliding windows
+ * and a precomputed table for the base point.
+ */
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include "../include/zb_ec256.h"
+#include "../include/zb_ed25519.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(zb_ed25519);
+
+/*
+ * The ed25519 root public keys are generated by imgtool in keys.c, the
+ * default is no ed25519 root keys.
+ */
+__weak const unsigned char ed25519_root_pub_key[ED25519_PUBLIC_KEY_BYTES];
+__weak const unsigned int ed25519_root_pub_key_len;
+
+/* SHA512 */
+struct sha512_state {
+	u64_t h[8];
+	u8_t buf[128];
+	size_t len;
+	u64_t total;
+};
+
+static const u64_t sha512_k[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+	0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+	0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+	0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+	0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+	0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+	0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+	0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+	0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+	0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+	0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+	0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+	0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+	0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+	0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+	0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+	0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+	0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+	0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+	0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+	0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+static u64_t ror64(u64_t x, int c)
+{
+	return (x >> c) | (x << (64 - c));
+}
+
+static u64_t ld64(const u8_t *p)
+{
+	u64_t r = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		r = (r << 8) | p[i];
+	}
+	return r;
+}
+
+static void st64(u8_t *p, u64_t x)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		p[i] = x & 0xff;
+		x >>= 8;
+	}
+}
+
+static void sha512_block(struct sha512_state *s, const u8_t *p)
+{
+	u64_t w[16], a[8], t1, t2;
+	int i, j;
+
+	for (i = 0; i < 16; i++) {
+		w[i] = ld64(p + 8 * i);
+	}
+	for (i = 0; i < 8; i++) {
+		a[i] = s->h[i];
+	}
+	for (i = 0; i < 80; i++) {
+		if (i >= 16) {
+			j = i & 15;
+			w[j] += w[(i + 9) & 15] +
+				(ror64(w[(i + 1) & 15], 1) ^
+				 ror64(w[(i + 1) & 15], 8) ^
+				 (w[(i + 1) & 15] >> 7)) +
+				(ror64(w[(i + 14) & 15], 19) ^
+				 ror64(w[(i + 14) & 15], 61) ^
+				 (w[(i + 14) & 15] >> 6));
+		}
+		t1 = a[7] + (ror64(a[4], 14) ^ ror64(a[4], 18) ^
+			     ror64(a[4], 41)) +
+		     ((a[4] & a[5]) ^ (~a[4] & a[6])) + sha512_k[i] +
+		     w[i & 15];
+		t2 = (ror64(a[0], 28) ^ ror64(a[0], 34) ^ ror64(a[0], 39)) +
+		     ((a[0] & a[1]) ^ (a[0] & a[2]) ^ (a[1] & a[2]));
+		for (j = 7; j > 0; j--) {
+			a[j] = a[j - 1];
+		}
+		a[4] += t1;
+		a[0] = t1 + t2;
+	}
+	for (i = 0; i < 8; i++) {
+		s->h[i] += a[i];
+	}
+}
+
+static void sha512_init(struct sha512_state *s)
+{
+	static const u64_t iv[8] = {
+		0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+		0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+		0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+		0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+	};
+
+	memcpy(s->h, iv, sizeof(iv));
+	s->len = 0;
+	s->total = 0;
+}
+
+static void sha512_update(struct sha512_state *s, const u8_t *p, size_t len)
+{
+	size_t cpy;
+
+	s->total += len;
+	while (len) {
+		cpy = MIN(len, sizeof(s->buf) - s->len);
+		memcpy(&s->buf[s->len], p, cpy);
+		s->len += cpy;
+		p += cpy;
+		len -= cpy;
+		if (s->len == sizeof(s->buf)) {
+			sha512_block(s, s->buf);
+			s->len = 0;
+		}
+	}
+}
+
+static void sha512_final(struct sha512_state *s, u8_t *hash)
+{
+	int i;
+
+	s->buf[s->len++] = 0x80;
+	if (s->len > 112) {
+		memset(&s->buf[s->len], 0, sizeof(s->buf) - s->len);
+		sha512_block(s, s->buf);
+		s->len = 0;
+	}
+	memset(&s->buf[s->len], 0, 120 - s->len);
+	st64(&s->buf[120], s->total << 3);
+	sha512_block(s, s->buf);
+	for (i = 0; i < 8; i++) {
+		st64(&hash[8 * i], s->h[i]);
+	}
+}
+
+/*
+ * Field arithmetic modulo 2^255 - 19: a field element uses 10 limbs of
+ * alternating 26 and 25 bit in a s32_t, products are accumulated in a s64_t.
+ * After a multiplication the limbs are reduced to 25 (24) bit plus sign, sums
+ * of up to three reduced elements can be multiplied without an overflow.
+ */
+typedef s32_t fe[10];
+
+static const fe ed_d = {
+	56195235, 13857412, 51736253, 6949390, 114729,
+	24766616, 60832955, 30306712, 48412415, 21499315
+};
+static const fe ed_d2 = {
+	45281625, 27714825, 36363642, 13898781, 229458,
+	15978800, 54557047, 27058993, 29715967, 9444199
+};
+static const fe ed_sqrtm1 = {
+	34513072, 25610706, 9377949, 3500415, 12389472,
+	33281959, 41962654, 31548777, 326685, 11406482
+};
+
+/* group order */
+static const s64_t ed_l[32] = {
+	0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+	0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+/* limb i has FE_BITS(i) bits */
+#define FE_BITS(i) (26 - ((i) & 1))
+
+static void fe_0(fe h)
+{
+	memset(h, 0, sizeof(fe));
+}
+
+static void fe_1(fe h)
+{
+	fe_0(h);
+	h[0] = 1;
+}
+
+static void fe_copy(fe h, const fe f)
+{
+	memcpy(h, f, sizeof(fe));
+}
+
+static void fe_add(fe h, const fe f, const fe g)
+{
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		h[i] = f[i] + g[i];
+	}
+}
+
+static void fe_sub(fe h, const fe f, const fe g)
+{
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		h[i] = f[i] - g[i];
+	}
+}
+
+/* Reduce the 19 partial products of a multiplication to a field element */
+static void fe_carry(fe h, s64_t t[19])
+{
+	s64_t c;
+	int i;
+
+	for (i = 0; i < 9; i++) {
+		t[i] += 19 * t[i + 10];
+	}
+	for (i = 0; i < 10; i++) {
+		c = (t[i] + ((s64_t)1 << (FE_BITS(i) - 1))) >> FE_BITS(i);
+		t[i] -= c * ((s64_t)1 << FE_BITS(i));
+		if (i < 9) {
+			t[i + 1] += c;
+		} else {
+			t[0] += 19 * c;
+		}
+	}
+	c = (t[0] + ((s64_t)1 << 25)) >> 26;
+	t[0] -= c * ((s64_t)1 << 26);
+	t[1] += c;
+	for (i = 0; i < 10; i++) {
+		h[i] = (s32_t)t[i];
+	}
+}
+
+static void fe_mul(fe h, const fe f, const fe g)
+{
+	s64_t t[19];
+	int i, j;
+
+	memset(t, 0, sizeof(t));
+	for (i = 0; i < 10; i++) {
+		for (j = 0; j < 10; j++) {
+			/* two odd limbs are both shifted down by half a bit */
+			t[i + j] += (s64_t)f[i] * (g[j] * (1 + (i & j & 1)));
+		}
+	}
+	fe_carry(h, t);
+}
+
+/* h = f^2, or 2 * f^2 when dbl is set */
+static void fe_sq_dbl(fe h, const fe f, bool dbl)
+{
+	s64_t t[19];
+	int i, j;
+
+	memset(t, 0, sizeof(t));
+	for (i = 0; i < 10; i++) {
+		t[2 * i] += (s64_t)f[i] * (f[i] * (1 + (i & 1)));
+		for (j = i + 1; j < 10; j++) {
+			t[i + j] += (s64_t)f[i] * (f[j] * (2 << (i & j & 1)));
+		}
+	}
+	if (dbl) {
+		for (i = 0; i < 19; i++) {
+			t[i] *= 2;
+		}
+	}
+	fe_carry(h, t);
+}
+
+static void fe_sq(fe h, const fe f)
+{
+	fe_sq_dbl(h, f, false);
+}
+
+/* h = f^(2^n) */
+static void fe_sqn(fe h, const fe f, int n)
+{
+	fe_sq(h, f);
+	while (--n) {
+		fe_sq(h, h);
+	}
+}
+
+static void fe_frombytes(fe h, const u8_t *s)
+{
+	u32_t v;
+	int i, pos = 0;
+
+	for (i = 0; i < 10; i++) {
+		/* a limb never spans more than 4 bytes */
+		v = s[pos / 8] | ((u32_t)s[pos / 8 + 1] << 8) |
+		    ((u32_t)s[pos / 8 + 2] << 16) |
+		    ((u32_t)s[pos / 8 + 3] << 24);
+		h[i] = (v >> (pos % 8)) & ((1U << FE_BITS(i)) - 1);
+		pos += FE_BITS(i);
+	}
+}
+
+/* Store the fully reduced (h mod p) element */
+static void fe_tobytes(u8_t *s, const fe f)
+{
+	fe h;
+	s32_t q, c;
+	u64_t acc = 0;
+	int i, j = 0, bits = 0;
+
+	fe_copy(h, f);
+	/* q is 1 when h >= p, 0 otherwise */
+	q = (19 * h[9] + (1 << 24)) >> 25;
+	for (i = 0; i < 10; i++) {
+		q = (h[i] + q) >> FE_BITS(i);
+	}
+	h[0] += 19 * q;
+	for (i = 0; i < 10; i++) {
+		c = h[i] >> FE_BITS(i);
+		h[i] -= c * (1 << FE_BITS(i));
+		if (i < 9) {
+			h[i + 1] += c;
+		}
+	}
+	for (i = 0; i < 10; i++) {
+		acc |= (u64_t)h[i] << bits;
+		bits += FE_BITS(i);
+		while (bits >= 8) {
+			s[j++] = acc & 0xff;
+			acc >>= 8;
+			bits -= 8;
+		}
+	}
+	s[j] = acc & 0xff;
+}
+
+static bool fe_isnonzero(const fe f)
+{
+	u8_t s[32];
+	u8_t r = 0;
+	int i;
+
+	fe_tobytes(s, f);
+	for (i = 0; i < 32; i++) {
+		r |= s[i];
+	}
+	return r != 0;
+}
+
+static u8_t fe_isnegative(const fe f)
+{
+	u8_t s[32];
+
+	fe_tobytes(s, f);
+	return s[0] & 1;
+}
+
+/* h = z^(2^255 - 21) = 1/z */
+static void fe_invert(fe h, const fe z)
+{
+	fe t0, t1, t2, t3;
+
+	fe_sq(t0, z);
+	fe_sqn(t1, t0, 2);
+	fe_mul(t1, z, t1);
+	fe_mul(t0, t0, t1);
+	fe_sq(t2, t0);
+	fe_mul(t1, t1, t2);
+	fe_sqn(t2, t1, 5);
+	fe_mul(t1, t2, t1);
+	fe_sqn(t2, t1, 10);
+	fe_mul(t2, t2, t1);
+	fe_sqn(t3, t2, 20);
+	fe_mul(t2, t3, t2);
+	fe_sqn(t2, t2, 10);
+	fe_mul(t1, t2, t1);
+	fe_sqn(t2, t1, 50);
+	fe_mul(t2, t2, t1);
+	fe_sqn(t3, t2, 100);
+	fe_mul(t2, t3, t2);
+	fe_sqn(t2, t2, 50);
+	fe_mul(t1, t2, t1);
+	fe_sqn(t1, t1, 5);
+	fe_mul(h, t1, t0);
+}
+
+/* h = z^(2^252 - 3) */
+static void fe_pow22523(fe h, const fe z)
+{
+	fe t0, t1, t2;
+
+	fe_sq(t0, z);
+	fe_sqn(t1, t0, 2);
+	fe_mul(t1, z, t1);
+	fe_mul(t0, t0, t1);
+	fe_sq(t0, t0);
+	fe_mul(t0, t1, t0);
+	fe_sqn(t1, t0, 5);
+	fe_mul(t0, t1, t0);
+	fe_sqn(t1, t0, 10);
+	fe_mul(t1, t1, t0);
+	fe_sqn(t2, t1, 20);
+	fe_mul(t1, t2, t1);
+	fe_sqn(t1, t1, 10);
+	fe_mul(t0, t1, t0);
+	fe_sqn(t1, t0, 50);
+	fe_mul(t1, t1, t0);
+	fe_sqn(t2, t1, 100);
+	fe_mul(t1, t2, t1);
+	fe_sqn(t1, t1, 50);
+	fe_mul(t0, t1, t0);
+	fe_sqn(t0, t0, 2);
+	fe_mul(h, t0, z);
+}
+
+/*
+ * Points: projective (X:Y:Z), extended (X:Y:Z:T) with T = XY/Z, completed
+ * ((X:Z),(Y:T)) as result of an addition, cached (Y+X, Y-X, Z, 2dT) for
+ * repeated additions and precomputed affine (y+x, y-x, 2dxy).
+ */
+struct ed_p2 {
+	fe X, Y, Z;
+};
+
+struct ed_p3 {
+	fe X, Y, Z, T;
+};
+
+struct ed_p1p1 {
+	fe X, Y, Z, T;
+};
+
+struct ed_cached {
+	fe YplusX, YminusX, Z, T2d;
+};
+
+struct ed_precomp {
+	fe yplusx, yminusx, xy2d;
+};
+
+/* Odd multiples B, 3B, ..., 15B of the base point */
+static const struct ed_precomp ed_bi[8] = {
+	{
+		{ 25967493, 19198397, 29566455, 3660896, 54414519,
+		  4014786, 27544626, 21800161, 61029707, 2047604 },
+		{ 54563134, 934261, 64385954, 3049989, 66381436,
+		  9406985, 12720692, 5043384, 19500929, 18085054 },
+		{ 58370664, 4489569, 9688441, 18769238, 10184608,
+		  21191052, 29287918, 11864899, 42594502, 29115885 },
+	},
+	{
+		{ 15636272, 23865875, 24204772, 25642034, 616976,
+		  16869170, 27787599, 18782243, 28944399, 32004408 },
+		{ 16568933, 4717097, 55552716, 32452109, 15682895,
+		  21747389, 16354576, 21778470, 7689661, 11199574 },
+		{ 30464137, 27578307, 55329429, 17883566, 23220364,
+		  15915852, 7512774, 10017326, 49359771, 23634074 },
+	},
+	{
+		{ 10861363, 11473154, 27284546, 1981175, 37044515,
+		  12577860, 32867885, 14515107, 51670560, 10819379 },
+		{ 4708026, 6336745, 20377586, 9066809, 55836755,
+		  6594695, 41455196, 12483687, 54440373, 5581305 },
+		{ 19563141, 16186464, 37722007, 4097518, 10237984,
+		  29206317, 28542349, 13850243, 43430843, 17738489 },
+	},
+	{
+		{ 5153727, 9909285, 1723747, 30776558, 30523604,
+		  5516873, 19480852, 5230134, 43156425, 18378665 },
+		{ 36839857, 30090922, 7665485, 10083793, 28475525,
+		  1649722, 20654025, 16520125, 30598449, 7715701 },
+		{ 28881826, 14381568, 9657904, 3680757, 46927229,
+		  7843315, 35708204, 1370707, 29794553, 32145132 },
+	},
+	{
+		{ 44589871, 26862249, 14201701, 24808930, 43598457,
+		  8844725, 18474211, 32192982, 54046167, 13821876 },
+		{ 60653668, 25714560, 3374701, 28813570, 40010246,
+		  22982724, 31655027, 26342105, 18853321, 19333481 },
+		{ 4566811, 20590564, 38133974, 21313742, 59506191,
+		  30723862, 58594505, 23123294, 2207752, 30344648 },
+	},
+	{
+		{ 41954014, 29368610, 29681143, 7868801, 60254203,
+		  24130566, 54671499, 32891431, 35997400, 17421995 },
+		{ 25576264, 30851218, 7349803, 21739588, 16472781,
+		  9300885, 3844789, 15725684, 171356, 6466918 },
+		{ 23103977, 13316479, 9739013, 17404951, 817874,
+		  18515490, 8965338, 19466374, 36393951, 16193876 },
+	},
+	{
+		{ 33587053, 3180712, 64714734, 14003686, 50205390,
+		  17283591, 17238397, 4729455, 49034351, 9256799 },
+		{ 41926547, 29380300, 32336397, 5036987, 45872047,
+		  11360616, 22616405, 9761698, 47281666, 630304 },
+		{ 53388152, 2639452, 42871404, 26147950, 9494426,
+		  27780403, 60554312, 17593437, 64659607, 19263131 },
+	},
+	{
+		{ 63957664, 28508356, 9282713, 6866145, 35201802,
+		  32691408, 48168288, 15033783, 25105118, 25659556 },
+		{ 42782475, 15950225, 35307649, 18961608, 55446126,
+		  28463506, 1573891, 30928545, 2198789, 17749813 },
+		{ 64009494, 10324966, 64867251, 7453182, 61661885,
+		  30818928, 53296841, 17317989, 34647629, 21263748 },
+	},
+};
+
+static void ed_p3_to_p2(struct ed_p2 *r, const struct ed_p3 *p)
+{
+	fe_copy(r->X, p->X);
+	fe_copy(r->Y, p->Y);
+	fe_copy(r->Z, p->Z);
+}
+
+static void ed_p3_to_cached(struct ed_cached *r, const struct ed_p3 *p)
+{
+	fe_add(r->YplusX, p->Y, p->X);
+	fe_sub(r->YminusX, p->Y, p->X);
+	fe_copy(r->Z, p->Z);
+	fe_mul(r->T2d, p->T, ed_d2);
+}
+
+static void ed_p1p1_to_p2(struct ed_p2 *r, const struct ed_p1p1 *p)
+{
+	fe_mul(r->X, p->X, p->T);
+	fe_mul(r->Y, p->Y, p->Z);
+	fe_mul(r->Z, p->Z, p->T);
+}
+
+static void ed_p1p1_to_p3(struct ed_p3 *r, const struct ed_p1p1 *p)
+{
+	fe_mul(r->X, p->X, p->T);
+	fe_mul(r->Y, p->Y, p->Z);
+	fe_mul(r->Z, p->Z, p->T);
+	fe_mul(r->T, p->X, p->Y);
+}
+
+static void ed_p2_dbl(struct ed_p1p1 *r, const struct ed_p2 *p)
+{
+	fe t0;
+
+	fe_sq(r->X, p->X);
+	fe_sq(r->Z, p->Y);
+	fe_sq_dbl(r->T, p->Z, true);
+	fe_add(r->Y, p->X, p->Y);
+	fe_sq(t0, r->Y);
+	fe_add(r->Y, r->Z, r->X);
+	fe_sub(r->Z, r->Z, r->X);
+	fe_sub(r->X, t0, r->Y);
+	fe_sub(r->T, r->T, r->Z);
+}
+
+static void ed_p3_dbl(struct ed_p1p1 *r, const struct ed_p3 *p)
+{
+	struct ed_p2 q;
+
+	ed_p3_to_p2(&q, p);
+	ed_p2_dbl(r, &q);
+}
+
+/*
+ * r = p + q (neg false) or r = p - q (neg true), q is given by (Y+X, Y-X, Z)
+ * and 2dT, for a affine (precomputed) q z is NULL.
+ */
+static void ed_add(struct ed_p1p1 *r, const struct ed_p3 *p, const fe yplusx,
+		   const fe yminusx, const fe z, const fe t2d, bool neg)
+{
+	fe t0;
+
+	fe_add(r->X, p->Y, p->X);
+	fe_sub(r->Y, p->Y, p->X);
+	fe_mul(r->Z, r->X, neg ? yminusx : yplusx);
+	fe_mul(r->Y, r->Y, neg ? yplusx : yminusx);
+	fe_mul(r->T, t2d, p->T);
+	if (z) {
+		fe_mul(r->X, p->Z, z);
+		fe_add(t0, r->X, r->X);
+	} else {
+		fe_add(t0, p->Z, p->Z);
+	}
+	fe_sub(r->X, r->Z, r->Y);
+	fe_add(r->Y, r->Z, r->Y);
+	if (neg) {
+		fe_sub(r->Z, t0, r->T);
+		fe_add(r->T, t0, r->T);
+	} else {
+		fe_add(r->Z, t0, r->T);
+		fe_sub(r->T, t0, r->T);
+	}
+}
+
+static void ed_add_cached(struct ed_p1p1 *r, const struct ed_p3 *p,
+			  const struct ed_cached *q, bool neg)
+{
+	ed_add(r, p, q->YplusX, q->YminusX, q->Z, q->T2d, neg);
+}
+
+static void ed_add_precomp(struct ed_p1p1 *r, const struct ed_p3 *p,
+			   const struct ed_precomp *q, bool neg)
+{
+	ed_add(r, p, q->yplusx, q->yminusx, NULL, q->xy2d, neg);
+}
+
+static void ed_tobytes(u8_t *s, const struct ed_p2 *p)
+{
+	fe recip, x, y;
+
+	fe_invert(recip, p->Z);
+	fe_mul(x, p->X, recip);
+	fe_mul(y, p->Y, recip);
+	fe_tobytes(s, y);
+	s[31] ^= fe_isnegative(x) << 7;
+}
+
+/*
+ * Recode a scalar (< 2^255) in signed digits: each nonzero digit is odd and
+ * in -max..max (max is 2^w - 1), nonzero digits are at least w positions
+ * apart.
+ */
+static void ed_slide(s8_t *r, const u8_t *a, int max)
+{
+	int i, b, k;
+
+	for (i = 0; i < 256; i++) {
+		r[i] = 1 & (a[i >> 3] >> (i & 7));
+	}
+	for (i = 0; i < 256; i++) {
+		if (!r[i]) {
+			continue;
+		}
+		for (b = 1; (b <= 6) && (i + b < 256); b++) {
+			if (!r[i + b]) {
+				continue;
+			}
+			if (r[i] + (r[i + b] << b) <= max) {
+				r[i] += r[i + b] << b;
+				r[i + b] = 0;
+			} else if (r[i] - (r[i + b] << b) >= -max) {
+				r[i] -= r[i + b] << b;
+				for (k = i + b; k < 256; k++) {
+					if (!r[k]) {
+						r[k] = 1;
+						break;
+					}
+					r[k] = 0;
+				}
+			} else {
+				break;
+			}
+		}
+	}
+}
+
+/* Table index of the odd multiple |d| */
+static int ed_digit_idx(s8_t d)
+{
+	return ((d < 0) ? -d : d) / 2;
+}
+
+/*
+ * Calculate r = [a]A + [b]B with B the base point using signed sliding
+ * windows: the odd multiples A..7A are calculated (on the stack), the odd
+ * multiples B..15B are in ed_bi. This is not constant time, it is only used
+ * on public data.
+ */
+static void ed_double_scalarmult(struct ed_p2 *r, const u8_t *a,
+				 const struct ed_p3 *pa, const u8_t *b)
+{
+	s8_t aslide[256], bslide[256];
+	struct ed_cached ai[4];
+	struct ed_p1p1 t;
+	struct ed_p3 u, a2;
+	int i;
+
+	ed_slide(aslide, a, 7);
+	ed_slide(bslide, b, 15);
+
+	ed_p3_to_cached(&ai[0], pa);
+	ed_p3_dbl(&t, pa);
+	ed_p1p1_to_p3(&a2, &t);
+	for (i = 0; i < 3; i++) {
+		ed_add_cached(&t, &a2, &ai[i], false);
+		ed_p1p1_to_p3(&u, &t);
+		ed_p3_to_cached(&ai[i + 1], &u);
+	}
+
+	fe_0(r->X);
+	fe_1(r->Y);
+	fe_1(r->Z);
+	for (i = 255; (i >= 0) && !aslide[i] && !bslide[i]; i--) {
+	}
+	for (; i >= 0; i--) {
+		ed_p2_dbl(&t, r);
+		if (aslide[i]) {
+			ed_p1p1_to_p3(&u, &t);
+			ed_add_cached(&t, &u, &ai[ed_digit_idx(aslide[i])],
+				      aslide[i] < 0);
+		}
+		if (bslide[i]) {
+			ed_p1p1_to_p3(&u, &t);
+			ed_add_precomp(&t, &u, &ed_bi[ed_digit_idx(bslide[i])],
+				       bslide[i] < 0);
+		}
+		ed_p1p1_to_p2(r, &t);
+	}
+}
+
+/* Unpack a point and negate it */
+static int ed_unpackneg(struct ed_p3 *r, const u8_t *s)
+{
+	fe u, v, v3, vxx, check;
+
+	fe_frombytes(r->Y, s);
+	fe_1(r->Z);
+	fe_sq(u, r->Y);
+	fe_mul(v, u, ed_d);
+	fe_sub(u, u, r->Z); /* u = y^2 - 1 */
+	fe_add(v, v, r->Z); /* v = dy^2 + 1 */
+
+	fe_sq(v3, v);
+	fe_mul(v3, v3, v); /* v3 = v^3 */
+	fe_sq(r->X, v3);
+	fe_mul(r->X, r->X, v);
+	fe_mul(r->X, r->X, u); /* x = uv^7 */
+
+	fe_pow22523(r->X, r->X);
+	fe_mul(r->X, r->X, v3);
+	fe_mul(r->X, r->X, u); /* x = uv^3(uv^7)^((q-5)/8) */
+
+	fe_sq(vxx, r->X);
+	fe_mul(vxx, vxx, v);
+	fe_sub(check, vxx, u); /* vx^2 - u */
+	if (fe_isnonzero(check)) {
+		fe_add(check, vxx, u); /* vx^2 + u */
+		if (fe_isnonzero(check)) {
+			return -EFAULT;
+		}
+		fe_mul(r->X, r->X, ed_sqrtm1);
+	}
+
+	if (fe_isnegative(r->X) == (s[31] >> 7)) {
+		fe_0(check);
+		fe_sub(r->X, check, r->X);
+	}
+
+	fe_mul(r->T, r->X, r->Y);
+	return 0;
+}
+
+/* Reduce a 512 bit number modulo the group order */
+static void ed_mod_l(u8_t *r, s64_t x[64])
+{
+	s64_t carry;
+	int i, j;
+
+	for (i = 63; i >= 32; i--) {
+		carry = 0;
+		for (j = i - 32; j < i - 12; j++) {
+			x[j] += carry - 16 * x[i] * ed_l[j - (i - 32)];
+			carry = (x[j] + 128) >> 8;
+			x[j] -= carry * 256;
+		}
+		x[j] += carry;
+		x[i] = 0;
+	}
+	carry = 0;
+	for (j = 0; j < 32; j++) {
+		x[j] += carry - (x[31] >> 4) * ed_l[j];
+		carry = x[j] >> 8;
+		x[j] &= 255;
+	}
+	for (j = 0; j < 32; j++) {
+		x[j] -= carry * ed_l[j];
+	}
+	for (i = 0; i < 32; i++) {
+		x[i + 1] += x[i] >> 8;
+		r[i] = x[i] & 255;
+	}
+}
+
+static void ed_reduce(u8_t *r)
+{
+	s64_t x[64];
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		x[i] = r[i];
+	}
+	memset(r, 0, 64);
+	ed_mod_l(r, x);
+}
+
+/* Check that the scalar s is smaller than the group order */
+static bool ed_scalar_ok(const u8_t *s)
+{
+	int i;
+
+	for (i = 31; i >= 0; i--) {
+		if (s[i] != ed_l[i]) {
+			return s[i] < ed_l[i];
+		}
+	}
+	return false;
+}
+
+int zb_ed25519_verify(const u8_t *msg, size_t len, const u8_t *signature,
+		      const u8_t *pubkey)
+{
+	struct sha512_state s;
+	u8_t t[32], h[64];
+	struct ed_p3 a;
+	struct ed_p2 r;
+
+	if ((!ed_scalar_ok(signature + 32)) || ed_unpackneg(&a, pubkey)) {
+		return -EFAULT;
+	}
+
+	sha512_init(&s);
+	sha512_update(&s, signature, 32);
+	sha512_update(&s, pubkey, ED25519_PUBLIC_KEY_BYTES);
+	sha512_update(&s, msg, len);
+	sha512_final(&s, h);
+	ed_reduce(h);
+
+	/* [h](-A) + [s]B must be equal to R */
+	ed_double_scalarmult(&r, h, &a, signature + 32);
+	ed_tobytes(t, &r);
+
+	if (memcmp(signature, t, 32)) {
+		return -EFAULT;
+	}
+	return 0;
+}
+
+int zb_ed25519_sign_verify(const u8_t *hash, const u8_t *signature,
+			   const u8_t *key_id)
+{
+	int cnt;
+	const u8_t *pubk;
+	u8_t id[KEY_ID_BYTES];
+
+	/* validate the hash for each of the root pubkeys, when a key id is
+	 * given only the matching root pubkey(s) are tried.
+	 */
+	cnt = 0;
+	while (cnt < ed25519_root_pub_key_len) {
+		pubk = (const u8_t *)&ed25519_root_pub_key[cnt];
+		cnt += ED25519_PUBLIC_KEY_BYTES;
+		if (key_id &&
+		    (zb_key_id(id, pubk, ED25519_PUBLIC_KEY_BYTES) ||
+		     memcmp(id, key_id, KEY_ID_BYTES))) {
+			continue;
+		}
+		if (!zb_ed25519_verify(hash, HASH_BYTES, signature, pubk)) {
+			return 0;
+		}
+	}
+	return -EFAULT;
+}
@@ -38,6 +38,39 @@ off_t zb_flash_align_offset(struct device *flash_dev, off_t offset)
 	return offset & ~(write_block_size - 1);
 }
 
+/* Checks that the region [offset, offset + len) can be erased in units of
+ * unit bytes: each erase page of the device has to be inside one unit.
+ */
+int zb_flash_layout_check(struct device *flash_dev, off_t offset, size_t len,
+			  size_t unit)
+{
+	if ((!unit) || (len % unit)) {
+		return -EINVAL;
+	}
+
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	struct flash_pages_info page;
+	off_t off = offset, pend;
+	int rc;
+
+	while (off < (offset + len)) {
+		rc = flash_get_page_info_by_offs(flash_dev, off, &page);
+		if (rc) {
+			return rc;
+		}
+		pend = page.start_offset + page.size;
+		if ((page.start_offset != off) || (pend > (offset + len)) ||
+		    (((off - offset) / unit) != ((pend - 1 - offset) / unit))) {
+			LOG_ERR("Erase page [%zx] not inside a unit of [%zx]",
+				(size_t)page.start_offset, unit);
+			return -EINVAL;
+		}
+		off = pend;
+	}
+#endif
+	return 0;
+}
+
 int zb_flash_erase(struct device *flash_dev, off_t offset, size_t len)
 {
 	int rc;
@@ -117,6 +150,211 @@ int zb_flash_read(struct device *flash_dev, off_t offset,
 	return flash_read(flash_dev, offset, data, len);
 }
 
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+/* Size of the sector that starts at off (from the slot start): the smallest
+ * size (at least SECTOR_SIZE) that ends on a erase page boundary in slot 0 and
+ * in slot 1.
+ */
+static size_t zb_sector_size(struct zb_slt_area *area, off_t off)
+{
+	size_t size = SECTOR_SIZE;
+	struct flash_pages_info page;
+	off_t pend;
+	size_t prev;
+
+	do {
+		prev = size;
+		if (((off + size) <= area->slt0_size) &&
+		    (!flash_get_page_info_by_offs(area->slt0_fldev,
+						  area->slt0_offset + off +
+						  size - 1, &page))) {
+			pend = page.start_offset + page.size;
+			size = MAX(size, pend - area->slt0_offset - off);
+		}
+		if (((off + size) <= area->slt1_size) &&
+		    (!flash_get_page_info_by_offs(area->slt1_fldev,
+						  area->slt1_offset + off +
+						  size - 1, &page))) {
+			pend = page.start_offset + page.size;
+			size = MAX(size, pend - area->slt1_offset - off);
+		}
+	} while (size != prev);
+	return size;
+}
+
+/* Make the sector map of area from the page layout. A move up copies a sector
+ * to the next one, so the sector size can only increase towards the slot end.
+ */
+static int zb_sector_map(struct zb_slt_area *area)
+{
+	struct zb_sector_run *run = NULL;
+	off_t off = 0;
+	size_t size;
+	u16_t sect = 0;
+
+	area->sect_run_cnt = 0;
+	while (off < MAX(area->slt0_size, area->slt1_size)) {
+		size = zb_sector_size(area, off);
+		if ((!run) || (size > run->size)) {
+			if (area->sect_run_cnt == ZB_SECTOR_RUNS) {
+				return -EINVAL;
+			}
+			run = &area->sect_run[area->sect_run_cnt++];
+			run->off = off;
+			run->size = size;
+			run->sect = sect;
+		} else if (size < run->size) {
+			return -EINVAL;
+		}
+		off += size;
+		sect++;
+	}
+	return 0;
+}
+
+/* Run of the sector that contains off (from the slot start) */
+static struct zb_sector_run *zb_sector_run_off(struct zb_slt_area *area,
+					       off_t off)
+{
+	u8_t i = 0;
+
+	while (((i + 1) < area->sect_run_cnt) &&
+	       (area->sect_run[i + 1].off <= off)) {
+		i++;
+	}
+	return &area->sect_run[i];
+}
+#endif
+
+off_t zb_sector_offset(struct zb_slt_area *area, u8_t sect, size_t *size)
+{
+	off_t off;
+	size_t ssize;
+
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	u8_t i = 0;
+
+	while (((i + 1) < area->sect_run_cnt) &&
+	       (area->sect_run[i + 1].sect <= sect)) {
+		i++;
+	}
+	ssize = area->sect_run[i].size;
+	off = area->sect_run[i].off + (sect - area->sect_run[i].sect) * ssize;
+#else
+	off = sect * SECTOR_SIZE;
+	ssize = SECTOR_SIZE;
+#endif
+	if (size) {
+		*size = ssize;
+	}
+	return off;
+}
+
+int zb_sector_cnt(struct zb_slt_area *area, size_t len)
+{
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	struct zb_sector_run *run;
+
+	if (!len) {
+		return 0;
+	}
+	run = zb_sector_run_off(area, len - 1);
+	return run->sect + (len - run->off + run->size - 1) / run->size;
+#else
+	return (len + SECTOR_SIZE - 1) / SECTOR_SIZE;
+#endif
+}
+
+size_t zb_sector_last(struct zb_slt_area *area, u8_t slt)
+{
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	size_t slt_size = slt ? area->slt1_size : area->slt0_size;
+
+	return zb_sector_run_off(area, slt_size - 1)->size;
+#else
+	return SECTOR_SIZE;
+#endif
+}
+
+bool zb_sector_uniform(struct zb_slt_area *area)
+{
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	return ((area->sect_run_cnt == 1) &&
+		(area->sect_run[0].size == SECTOR_SIZE));
+#else
+	return true;
+#endif
+}
+
+/* The sectors have to fill the slot, each sector consists of complete erase
+ * pages.
+ */
+static int zb_slt_layout_check(struct zb_slt_area *area, struct device *dev,
+			       off_t offset, size_t slt_size)
+{
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	struct zb_sector_run *run;
+	off_t end;
+	u8_t i;
+	int rc;
+
+	for (i = 0; i < area->sect_run_cnt; i++) {
+		run = &area->sect_run[i];
+		if (run->off >= slt_size) {
+			break;
+		}
+		end = ((i + 1) < area->sect_run_cnt) ?
+		      MIN(area->sect_run[i + 1].off, slt_size) : slt_size;
+		rc = zb_flash_layout_check(dev, offset + run->off,
+					   end - run->off, run->size);
+		if (rc) {
+			return rc;
+		}
+	}
+	return 0;
+#else
+	return zb_flash_layout_check(dev, offset, slt_size, SECTOR_SIZE);
+#endif
+}
+
+/* The slots are erased per sector, the swap status commands are erased at once
+ * and the scratch sectors per sector (scratch requires SECTOR_SIZE sectors).
+ */
+static int zb_slt_area_layout_check(struct zb_slt_area *area)
+{
+	size_t cmd_size;
+	int rc;
+
+	rc = zb_slt_layout_check(area, area->slt0_fldev, area->slt0_offset,
+				 area->slt0_size);
+	if (rc) {
+		return rc;
+	}
+	rc = zb_slt_layout_check(area, area->slt1_fldev, area->slt1_offset,
+				 area->slt1_size);
+	if (rc) {
+		return rc;
+	}
+	cmd_size = area->swpstat_size - area->scratch_cnt * SECTOR_SIZE;
+	rc = zb_flash_layout_check(area->swpstat_fldev, area->swpstat_offset,
+				   cmd_size, cmd_size);
+	if (rc || (!area->scratch_cnt)) {
+		return rc;
+	}
+	if (!zb_sector_uniform(area)) {
+		return -EINVAL;
+	}
+	/* the scratch sectors must not wear out much faster than the slot */
+	if (area->slt1_size / SECTOR_SIZE >
+	    ZB_SCRATCH_WEAR * area->scratch_cnt) {
+		return -EINVAL;
+	}
+	return zb_flash_layout_check(area->swpstat_fldev,
+				     area->swpstat_offset + cmd_size,
+				     area->scratch_cnt * SECTOR_SIZE,
+				     SECTOR_SIZE);
+}
+
 u8_t zb_slt_area_cnt(void)
 {
 	return slot_map_cnt;
@@ -131,6 +369,12 @@ int zb_slt_area_get(struct zb_slt_area *area,  u8_t slt_idx)
 	area->slt0_size = slot_map[slt_idx].slt0_size;
 	area->slt1_size = slot_map[slt_idx].slt1_size;
 	area->swpstat_size = slot_map[slt_idx].swpstat_size;
+	area->scratch_cnt = slot_map[slt_idx].scratch_cnt;
+	area->prio = slot_map[slt_idx].prio;
+	area->swp_budget_ms = slot_map[slt_idx].swp_budget_ms;
+	if ((area->scratch_cnt * SECTOR_SIZE) >= area->swpstat_size) {
+		return -EINVAL;
+	}
 
 	area->slt0_fldev = device_get_binding(slot_map[slt_idx].slt0_devname);
 	if (!area->slt0_fldev) {
@@ -145,7 +389,12 @@ int zb_slt_area_get(struct zb_slt_area *area,  u8_t slt_idx)
 	if (!area->swpstat_fldev) {
 		return -ENXIO;
 	}
-	return 0;
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+	if (zb_sector_map(area)) {
+		return -EINVAL;
+	}
+#endif
+	return zb_slt_area_layout_check(area);
 }
 
 bool zb_in_ram(off_t address)
@@ -184,12 +433,80 @@ static int zb_cmd_crc8(struct zb_cmd *cmd)
 	return 1;
 }
 
+/* The crc table follows zb_prm in slt0end, it contains one entry (aligned
+ * to the write block size) for each sector of slt0 and slt1. When the table
+ * would take more than half of slt0end it is not used.
+ */
+static size_t zb_crc_tbl_size(struct zb_slt_area *area)
+{
+	size_t size;
+
+	size = (area->slt0_size + area->slt1_size) / SECTOR_SIZE;
+	size *= zb_flash_align_size(area->slt0_fldev, sizeof(u32_t));
+	if (size > (zb_sector_last(area, 0) / 2)) {
+		return 0;
+	}
+	return size;
+}
+
+static int zb_crc_tbl_offset(struct zb_slt_area *area, u8_t slt, u32_t sect,
+			     off_t *off)
+{
+	size_t step;
+	u32_t idx;
+
+	if (!zb_crc_tbl_size(area)) {
+		return -ENOSPC;
+	}
+
+	idx = sect;
+	if (slt == 1) {
+		if (sect >= (area->slt1_size / SECTOR_SIZE)) {
+			return -EINVAL;
+		}
+		idx += area->slt0_size / SECTOR_SIZE;
+	} else {
+		if (sect >= (area->slt0_size / SECTOR_SIZE)) {
+			return -EINVAL;
+		}
+	}
+
+	step = zb_flash_align_size(area->slt0_fldev, sizeof(u32_t));
+	*off = area->slt0_offset + area->slt0_size - zb_sector_last(area, 0);
+	*off += zb_flash_align_size(area->slt0_fldev, sizeof(struct zb_prm));
+	*off += idx * step;
+	return 0;
+}
+
 struct zb_cmd_loc {
 	off_t start;
 	off_t end;
 	struct device *fl_dev;
 };
 
+/* End of the swap status commands and zb_idle, the scratch sectors follow */
+static off_t zb_swpstat_end(struct zb_slt_area *area)
+{
+	return area->swpstat_offset + area->swpstat_size -
+	       area->scratch_cnt * SECTOR_SIZE;
+}
+
+u32_t zb_scratch_start(struct zb_slt_area *area)
+{
+	struct zb_prm prm;
+
+	if (zb_prm_read(area, &prm) || (prm.prm_ver != ZB_PRM_VERSION)) {
+		return 0;
+	}
+	return prm.scr_start;
+}
+
+off_t zb_scratch_offset(struct zb_slt_area *area, u32_t start, u32_t sect)
+{
+	return zb_swpstat_end(area) +
+	       ((start + sect) % area->scratch_cnt) * SECTOR_SIZE;
+}
+
 int zb_get_cmd_loc(struct zb_slt_area *area, struct zb_cmd_loc *loc,
 		   const u8_t loc_id)
 {
@@ -197,16 +514,19 @@ int zb_get_cmd_loc(struct zb_slt_area *area, struct zb_cmd_loc *loc,
 		case 0:
 			loc->fl_dev = area->slt0_fldev;
 			loc->end = area->slt0_offset + area->slt0_size;
-			loc->start = loc->end - SECTOR_SIZE;
+			loc->start = loc->end - zb_sector_last(area, 0);
 			break;
 		case 1:
 			loc->fl_dev = area->slt1_fldev;
 			loc->end = area->slt1_offset + area->slt1_size;
-			loc->start = loc->end - SECTOR_SIZE;
+			loc->start = loc->end - zb_sector_last(area, 1);
 			break;
 		case 2:
+			/* the last write block is reserved for zb_idle */
 			loc->fl_dev = area->swpstat_fldev;
-			loc->end = area->swpstat_offset + area->swpstat_size;
+			loc->end = zb_swpstat_end(area) -
+				   zb_flash_align_size(loc->fl_dev,
+						       sizeof(struct zb_idle));
 			loc->start = area->swpstat_offset;
 			break;
 		default:
@@ -223,14 +543,11 @@ int zb_cmd_loc_erase(struct zb_cmd_loc *loc)
 
 int zb_erase_swpstat(struct zb_slt_area *area)
 {
-	struct zb_cmd_loc loc;
-	int rc;
-
-	rc = zb_get_cmd_loc(area, &loc, 2);
-	if (rc) {
-		return rc;
-	}
-	return zb_cmd_loc_erase(&loc);
+	/* erase the commands and the zb_idle record, scratch sectors are erased
+	 * when they are used
+	 */
+	return zb_flash_erase(area->swpstat_fldev, area->swpstat_offset,
+			      zb_swpstat_end(area) - area->swpstat_offset);
 }
 
 int zb_erase_slt0end(struct zb_slt_area *area)
@@ -278,6 +595,7 @@ int zb_cmd_read(struct zb_slt_area *area, struct zb_cmd *cmd, u8_t loc_id)
 
 	if (loc_id == 0) {
 		off += zb_flash_align_size(loc.fl_dev, sizeof(struct zb_prm));
+		off += zb_crc_tbl_size(area);
 	}
 
 	while (1) {
@@ -331,6 +649,21 @@ int zb_cmd_read_swpstat(struct zb_slt_area *area, struct zb_cmd *cmd)
 	return zb_cmd_read(area, cmd, 2);
 }
 
+int zb_cmd_read_swpstat_first(struct zb_slt_area *area, struct zb_cmd *cmd)
+{
+	int rc;
+
+	rc = zb_flash_read(area->swpstat_fldev, area->swpstat_offset, cmd,
+			   sizeof(struct zb_cmd));
+	if (rc) {
+		return rc;
+	}
+	if (zb_cmd_crc8(cmd)) {
+		return -ENOENT;
+	}
+	return 0;
+}
+
 int zb_cmd_write(struct zb_slt_area *area, struct zb_cmd *cmd, u8_t loc_id)
 {
 	int rc;
@@ -351,6 +684,7 @@ int zb_cmd_write(struct zb_slt_area *area, struct zb_cmd *cmd, u8_t loc_id)
 
 	if (loc_id == 0) {
 		off += zb_flash_align_size(loc.fl_dev, sizeof(struct zb_prm));
+		off += zb_crc_tbl_size(area);
 	}
 
 	while (1) {
@@ -394,12 +728,141 @@ int zb_cmd_write_swpstat(struct zb_slt_area *area, struct zb_cmd *cmd)
 	return zb_cmd_write(area, cmd, 2);
 }
 
+static off_t zb_idle_offset(struct zb_slt_area *area)
+{
+	return zb_swpstat_end(area) -
+	       zb_flash_align_size(area->swpstat_fldev, sizeof(struct zb_idle));
+}
+
+/* crc8 calculation and verification for zb_idle, same rules as zb_cmd_crc8 */
+static int zb_idle_crc8(struct zb_idle *idle)
+{
+	u8_t crc8;
+
+	crc8 = idle->crc8;
+	idle->crc8 = crc8_ccitt(0xff, idle, offsetof(struct zb_idle, crc8));
+	if (idle->crc8 == crc8) {
+		return 0;
+	}
+	return 1;
+}
+
+int zb_idle_read(struct zb_slt_area *area, struct zb_idle *idle)
+{
+	int rc;
+	struct zb_cmd_loc loc;
+	u8_t buf[2 * ALIGN_BUF_SIZE];
+	off_t off;
+	size_t step, len = 0;
+	u32_t re_cmd_u32;
+
+	rc = zb_flash_read(area->swpstat_fldev, zb_idle_offset(area), idle,
+			   sizeof(struct zb_idle));
+	if (rc) {
+		return rc;
+	}
+
+	if ((idle->cnt == (u16_t)EMPTY_U32) || zb_idle_crc8(idle)) {
+		return -ENOENT;
+	}
+
+	rc = zb_get_cmd_loc(area, &loc, 1);
+	if (rc) {
+		return rc;
+	}
+
+	/* read the last known entry and the first free entry in one go */
+	step = zb_flash_align_size(loc.fl_dev, sizeof(struct zb_cmd));
+	off = loc.start + idle->cnt * step;
+	if (idle->cnt) {
+		off -= step;
+		len += step;
+	}
+	if ((off + len) < loc.end) {
+		len += sizeof(struct zb_cmd);
+	}
+	if ((len == 0) || ((off + len) > loc.end)) {
+		return -ENOENT;
+	}
+
+	rc = zb_flash_read(loc.fl_dev, off, buf, len);
+	if (rc) {
+		return rc;
+	}
+
+	if (idle->cnt) {
+		if (memcmp(buf, &idle->last, sizeof(struct zb_cmd))) {
+			return -ENOENT;
+		}
+		len -= step;
+	}
+	if (len) {
+		memcpy(&re_cmd_u32, &buf[idle->cnt ? step : 0], 4);
+		if (re_cmd_u32 != EMPTY_U32) {
+			return -ENOENT;
+		}
+	}
+
+	return 0;
+}
+
+int zb_idle_write(struct zb_slt_area *area)
+{
+	int rc;
+	struct zb_idle idle;
+	struct zb_cmd re_cmd;
+	struct zb_cmd_loc loc;
+	off_t off;
+	u32_t re_cmd_u32;
+
+	rc = zb_get_cmd_loc(area, &loc, 1);
+	if (rc) {
+		return rc;
+	}
+
+	memset(&idle, 0, sizeof(struct zb_idle));
+	off = loc.start;
+	while (off < loc.end) {
+		rc = zb_flash_read(loc.fl_dev, off, &re_cmd,
+				   sizeof(struct zb_cmd));
+		if (rc) {
+			return rc;
+		}
+		memcpy(&re_cmd_u32, &re_cmd, 4);
+		if (re_cmd_u32 == EMPTY_U32) {
+			break;
+		}
+		idle.last = re_cmd;
+		idle.cnt++;
+		if (!zb_cmd_crc8(&re_cmd)) {
+			idle.cmd1 = re_cmd.cmd1;
+		}
+		off += zb_flash_align_size(loc.fl_dev, sizeof(struct zb_cmd));
+	}
+
+	off = zb_idle_offset(area);
+	rc = zb_flash_read(area->swpstat_fldev, off, &re_cmd_u32, 4);
+	if (rc) {
+		return rc;
+	}
+	if (re_cmd_u32 != EMPTY_U32) {
+		/* outdated idle record, only an erase allows a rewrite */
+		rc = zb_erase_swpstat(area);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	(void) zb_idle_crc8(&idle);
+	return zb_flash_write(area->swpstat_fldev, off, &idle,
+			      sizeof(struct zb_idle));
+}
 
 int zb_prm_read(struct zb_slt_area *area, struct zb_prm *prm)
 {
 	int rc;
 	off_t off;
-	off = area->slt0_offset + area->slt0_size - SECTOR_SIZE;
+	off = area->slt0_offset + area->slt0_size - zb_sector_last(area, 0);
 	rc = zb_flash_read(area->slt0_fldev, off, prm, sizeof(struct zb_prm));
 	if (rc) {
 		return rc;
@@ -413,7 +876,40 @@ int zb_prm_read(struct zb_slt_area *area, struct zb_prm *prm)
 int zb_prm_write(struct zb_slt_area *area, struct zb_prm *prm)
 {
 	off_t off;
-	off = area->slt0_offset + area->slt0_size - SECTOR_SIZE;
+	off = area->slt0_offset + area->slt0_size - zb_sector_last(area, 0);
 	return zb_flash_write(area->slt0_fldev, off, prm,
 			      sizeof(struct zb_prm));
 }
+
+int zb_crc_tbl_read(struct zb_slt_area *area, u8_t slt, u32_t sect,
+		    u32_t *crc32)
+{
+	int rc;
+	off_t off;
+
+	rc = zb_crc_tbl_offset(area, slt, sect, &off);
+	if (rc) {
+		return rc;
+	}
+	rc = zb_flash_read(area->slt0_fldev, off, crc32, sizeof(u32_t));
+	if (rc) {
+		return rc;
+	}
+	if (*crc32 == EMPTY_U32) {
+		return -ENOENT;
+	}
+	return 0;
+}
+
+int zb_crc_tbl_write(struct zb_slt_area *area, u8_t slt, u32_t sect,
+		     u32_t crc32)
+{
+	int rc;
+	off_t off;
+
+	rc = zb_crc_tbl_offset(area, slt, sect, &off);
+	if (rc) {
+		return rc;
+	}
+	return zb_flash_write(area->slt0_fldev, off, &crc32, sizeof(u32_t));
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2019 LaczenJMS.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <crc.h>
+
+#include "../include/zb_handoff.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(zb_handoff);
+
+void zb_handoff_write(struct zb_handoff *ho, zb_img_info *info)
+{
+	ho->magic = ZB_HANDOFF_MAGIC;
+	ho->version = ZB_HANDOFF_VERSION;
+	ho->img.hdr_start = info->hdr_start;
+	ho->img.start = info->start;
+	ho->img.end = info->end;
+	ho->img.load_address = info->load_address;
+	ho->img.version = info->version;
+	ho->img.type = info->type;
+	ho->crc32 = crc32_ieee((const u8_t *)ho,
+			       offsetof(struct zb_handoff, crc32));
+}
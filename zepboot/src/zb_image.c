@@ -6,6 +6,7 @@
 
 #include <zephyr.h>
 #include <device.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #include <crc.h>
@@ -18,6 +19,33 @@
 #include <logging/log.h>
 LOG_MODULE_REGISTER(zb_image);
 
+/* The sector hash table is located after the image (aligned) */
+static off_t zb_img_sect_tbl_offset(zb_img_info *info)
+{
+	return info->hdr_start + zb_flash_align_size(info->flash_device,
+						     info->end - info->hdr_start);
+}
+
+static u8_t zb_img_sect_cnt(zb_img_info *info)
+{
+	return (info->end - info->hdr_start + SECTOR_SIZE - 1) / SECTOR_SIZE;
+}
+
+/* The restart table of a compressed image is located after the stream
+ * (aligned), it has a entry for each sector of the expanded image.
+ */
+static off_t zb_img_cmp_tbl_offset(zb_img_info *info)
+{
+	return info->hdr_start + zb_flash_align_size(info->flash_device,
+						     info->cmp_end - info->hdr_start);
+}
+
+static off_t zb_img_cmp_tbl_end(zb_img_info *info)
+{
+	return zb_img_cmp_tbl_offset(info) +
+	       zb_img_sect_cnt(info) * sizeof(u32_t);
+}
+
 int zb_img_get_info(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
 		    off_t eoff, bool val_tlv,  bool val_img)
 {
@@ -25,8 +53,13 @@ int zb_img_get_info(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
 	off_t offset;
 	tlv_entry entry;
 	zb_tlv_img_info rd_info;
+	zb_tlv_sect_hash sect_hash;
+	zb_tlv_img_cmp img_cmp;
+	zb_tlv_img_delta img_delta;
 	u8_t tlv[TLV_AREA_MAX_SIZE];
 	u8_t calc_hash[HASH_BYTES];
+	u8_t img_hash[HASH_BYTES];
+	u8_t *epubkey, key_size, tlva_type, i;
 	struct device *fl_dev;
 
 	info->is_valid = false;
@@ -46,6 +79,16 @@ int zb_img_get_info(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
 	info->enc_start = info->hdr_start;
 	info->end = info->hdr_start;
 	info->load_address = info->hdr_start;
+	info->has_phash = false;
+	info->has_sect_hash = false;
+	info->hash_type = HASH_TYPE_SHA256;
+	info->enc_type = ENC_TYPE_AES128_CTR;
+	info->has_cmp = false;
+	info->is_cmp = false;
+	info->is_delta = false;
+	info->is_predec = false;
+	info->seg_cnt = 0;
+	info->seg_offset = info->hdr_start;
 	memset(&(info->version), 0, sizeof(img_ver));
 
 	/* open the tlv area, only do signature verification for slt1 */
@@ -55,6 +98,12 @@ int zb_img_get_info(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
 		return tlv_size;
 	}
 
+	rc = zb_flash_read(fl_dev, offset + offsetof(tlv_area_hdr, tlva_type),
+			   &tlva_type, sizeof(tlva_type));
+	if (rc) {
+		return rc;
+	}
+
 	offset = 0;
 	entry.type = 0;
 	while ((entry.type != TLVE_IMAGE_TYPE) && (offset < tlv_size)) {
@@ -82,6 +131,31 @@ int zb_img_get_info(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
 	info->load_address = rd_info.load_address;
 	info->version = rd_info.version;
 
+	/* segments with image data have to be inside the image */
+	offset = 0;
+	entry.type = 0;
+	while ((entry.type != TLVE_IMAGE_SEG) && (offset < tlv_size)) {
+		zb_step_tlv(tlv, &offset, &entry);
+	}
+	if (entry.type == TLVE_IMAGE_SEG) {
+		if ((entry.length % TLVE_IMAGE_SEG_BYTES) ||
+		    ((entry.length / TLVE_IMAGE_SEG_BYTES) > IMG_SEG_MAX)) {
+			return -EFAULT;
+		}
+		info->seg_cnt = entry.length / TLVE_IMAGE_SEG_BYTES;
+		info->seg_offset = info->hdr_start + sizeof(tlv_area_hdr) +
+				   (entry.value - tlv) - 2;
+		memcpy(info->seg, entry.value, entry.length);
+		for (i = 0; i < info->seg_cnt; i++) {
+			if ((info->seg[i].flags & SEG_FLAG_LOAD) &&
+			    ((info->seg[i].offset > rd_info.size) ||
+			     (info->seg[i].size >
+			      (rd_info.size - info->seg[i].offset)))) {
+				return -EFAULT;
+			}
+		}
+	}
+
 	offset = 0;
 	entry.type = 0;
 	while ((entry.type != TLVE_IMAGE_HASH) && (offset < tlv_size)) {
@@ -91,10 +165,123 @@ int zb_img_get_info(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
 	    (entry.length != TLVE_IMAGE_HASH_BYTES)) {
 		return -EFAULT;
 	}
-	if (val_img) {
-		rc = zb_hash_flash(calc_hash, fl_dev, info->start + eoff,
-				   rd_info.size);
-		if (memcmp(entry.value, calc_hash, HASH_BYTES)) {
+	memcpy(img_hash, entry.value, HASH_BYTES);
+
+	/* the hash type applies to all image hashes (image, unencrypted image
+	 * and sector hashes), the default is SHA256
+	 */
+	offset = 0;
+	entry.type = 0;
+	while ((entry.type != TLVE_IMAGE_HASH_TYPE) && (offset < tlv_size)) {
+		zb_step_tlv(tlv, &offset, &entry);
+	}
+	if ((entry.type == TLVE_IMAGE_HASH_TYPE) &&
+	    (entry.length == TLVE_IMAGE_HASH_TYPE_BYTES)) {
+		info->hash_type = *entry.value;
+		if ((info->hash_type != HASH_TYPE_SHA256) &&
+		    (info->hash_type != HASH_TYPE_BLAKE2S)) {
+			return -EFAULT;
+		}
+	}
+
+	offset = 0;
+	entry.type = 0;
+	while ((entry.type != TLVE_IMAGE_PHASH) && (offset < tlv_size)) {
+		zb_step_tlv(tlv, &offset, &entry);
+	}
+	if ((entry.type == TLVE_IMAGE_PHASH) &&
+	    (entry.length == TLVE_IMAGE_PHASH_BYTES)) {
+		memcpy(info->phash, entry.value, entry.length);
+		info->has_phash = true;
+	}
+
+	/* a compressed image is stored compressed until a swap has moved it
+	 * to slot 1 (expanded)
+	 */
+	offset = 0;
+	entry.type = 0;
+	while ((entry.type != TLVE_IMAGE_CMP) && (offset < tlv_size)) {
+		zb_step_tlv(tlv, &offset, &entry);
+	}
+	if ((entry.type == TLVE_IMAGE_CMP) &&
+	    (entry.length == TLVE_IMAGE_CMP_BYTES)) {
+		memcpy(&img_cmp, entry.value, entry.length);
+		if ((img_cmp.sect_size != SECTOR_SIZE) ||
+		    (!zb_sector_uniform(area))) {
+			return -EFAULT;
+		}
+		info->has_cmp = true;
+		info->is_cmp = ((tlva_type & TLVA_TYPE_EXPANDED) == 0);
+		info->cmp_start = info->hdr_start + img_cmp.start;
+		info->cmp_end = info->cmp_start + img_cmp.size;
+	}
+
+	/* a delta image is a compressed image that refers to the base image,
+	 * once it is expanded it no longer depends on the base image
+	 */
+	offset = 0;
+	entry.type = 0;
+	while ((entry.type != TLVE_IMAGE_DELTA) && (offset < tlv_size)) {
+		zb_step_tlv(tlv, &offset, &entry);
+	}
+	if ((entry.type == TLVE_IMAGE_DELTA) &&
+	    (entry.length == TLVE_IMAGE_DELTA_BYTES)) {
+		if (!info->has_cmp) {
+			return -EFAULT;
+		}
+		memcpy(&img_delta, entry.value, entry.length);
+		info->is_delta = info->is_cmp;
+		info->base_ver = img_delta.version;
+		info->base_crc32 = img_delta.crc32;
+	}
+
+	/* a image that was decrypted in slot 1 by the application is checked
+	 * against the hash of the unencrypted image
+	 */
+	if (tlva_type & TLVA_TYPE_DECRYPTED) {
+		if (info->has_cmp || (!info->has_phash)) {
+			return -EFAULT;
+		}
+		info->is_predec = true;
+		memcpy(img_hash, info->phash, HASH_BYTES);
+	}
+
+	if (val_img && info->is_cmp) {
+		/* the image hash covers the stream and the restart table */
+		rc = zb_hash_flash_type(calc_hash, info->hash_type, fl_dev,
+					info->cmp_start + eoff,
+					zb_img_cmp_tbl_end(info) -
+					info->cmp_start);
+		if (rc || memcmp(img_hash, calc_hash, HASH_BYTES)) {
+			return -EFAULT;
+		}
+		val_img = false;
+	}
+
+	offset = 0;
+	entry.type = 0;
+	while ((entry.type != TLVE_IMAGE_SECT_HASH) && (offset < tlv_size)) {
+		zb_step_tlv(tlv, &offset, &entry);
+	}
+	if ((entry.type == TLVE_IMAGE_SECT_HASH) &&
+	    (entry.length == TLVE_IMAGE_SECT_HASH_BYTES)) {
+		memcpy(&sect_hash, entry.value, entry.length);
+		if ((sect_hash.sect_size == SECTOR_SIZE) && (!info->has_cmp) &&
+		    (!info->is_predec) && zb_sector_uniform(area)) {
+			memcpy(info->sect_root, sect_hash.root, HASH_BYTES);
+			info->has_sect_hash = true;
+		}
+	}
+
+	if (val_img && info->has_sect_hash) {
+		/* the sectors are checked when they are used */
+		if (zb_img_check_sect_tbl(info, eoff)) {
+			return -EFAULT;
+		}
+	} else if (val_img) {
+		rc = zb_hash_flash_type(calc_hash, info->hash_type, fl_dev,
+					info->start + eoff, rd_info.size);
+		if (memcmp(img_hash, calc_hash, HASH_BYTES)) {
 			return -EFAULT;
 		}
 	}
@@ -105,11 +292,31 @@ int zb_img_get_info(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
 		zb_step_tlv(tlv, &offset, &entry);
 	}
 	if ((entry.type != TLVE_IMAGE_EPUBKEY) ||
-	    (entry.length != TLVE_IMAGE_EPUBKEY_BYTES)) {
+	    (entry.length != TLVE_IMAGE_EPUBKEY_BYTES) || info->is_predec) {
 		info->enc_start = info->end;
 	} else {
-		if (zb_get_encr_key(info->enc_key, entry.value,
-				    AES_BLOCK_SIZE)) {
+		epubkey = entry.value;
+		offset = 0;
+		entry.type = 0;
+		while ((entry.type != TLVE_IMAGE_ENC_TYPE) &&
+		       (offset < tlv_size)) {
+			zb_step_tlv(tlv, &offset, &entry);
+		}
+		if ((entry.type == TLVE_IMAGE_ENC_TYPE) &&
+		    (entry.length == TLVE_IMAGE_ENC_TYPE_BYTES)) {
+			info->enc_type = *entry.value;
+		}
+		switch (info->enc_type) {
+		case ENC_TYPE_AES128_CTR:
+			key_size = AES_BLOCK_SIZE;
+			break;
+		case ENC_TYPE_CHACHA20:
+			key_size = CHACHA20_KEY_BYTES;
+			break;
+		default:
+			return -EFAULT;
+		}
+		if (zb_get_encr_key(info->enc_key, epubkey, key_size)) {
 			return -EFAULT;
 		}
 		info->enc_start = info->start;
@@ -130,18 +337,238 @@ void zb_img_get_info_wsc(zb_img_info *info, struct zb_slt_area *area, u8_t slt,
 	zb_img_get_info(info, area, slt, eoff, true, val_img);
 }
 
+/* Read the segment table tlv entry at offset (the location is taken from the
+ * prm, the table was checked when the image was swapped)
+ */
+static int zb_img_read_seg(zb_img_info *info, off_t offset)
+{
+	int rc;
+	u8_t i, tl[2];
+
+	rc = zb_flash_read(info->flash_device, offset, tl, sizeof(tl));
+	if (rc) {
+		return rc;
+	}
+	if ((tl[0] != TLVE_IMAGE_SEG) || (tl[1] % TLVE_IMAGE_SEG_BYTES) ||
+	    ((tl[1] / TLVE_IMAGE_SEG_BYTES) > IMG_SEG_MAX)) {
+		return -EFAULT;
+	}
+	rc = zb_flash_read(info->flash_device, offset + sizeof(tl), info->seg,
+			   tl[1]);
+	if (rc) {
+		return rc;
+	}
+	info->seg_cnt = tl[1] / TLVE_IMAGE_SEG_BYTES;
+	info->seg_offset = offset;
+	for (i = 0; i < info->seg_cnt; i++) {
+		if ((info->seg[i].flags & SEG_FLAG_LOAD) &&
+		    ((info->seg[i].offset > info->end - info->start) ||
+		     (info->seg[i].size >
+		      (info->end - info->start - info->seg[i].offset)))) {
+			return -EFAULT;
+		}
+	}
+	return 0;
+}
+
+int zb_img_get_info_prm(zb_img_info *info, struct zb_slt_area *area,
+			struct zb_prm *prm, u8_t slt)
+{
+	u32_t flags;
+	off_t seg_offset;
+
+	info->is_valid = false;
+	if (prm->prm_ver != ZB_PRM_VERSION) {
+		return -ENOENT;
+	}
+
+	memset(&(info->version), 0, sizeof(img_ver));
+	info->type = 0;
+	info->has_phash = false;
+	info->hash_type = HASH_TYPE_SHA256;
+	info->enc_type = ENC_TYPE_AES128_CTR;
+	info->has_cmp = false;
+	info->is_cmp = false;
+	info->is_delta = false;
+	info->is_predec = false;
+	info->seg_cnt = 0;
+	if (slt == 1) {
+		if (prm->slt1_size == 0) {
+			return -ENOENT;
+		}
+		zb_img_conv_u32_version(prm->slt1_ver, &info->version);
+		info->flash_device = area->slt1_fldev;
+		info->hdr_start = area->slt1_offset;
+		info->start = prm->slt1_start;
+		info->end = prm->slt1_start + prm->slt1_size;
+		info->load_address = prm->slt1_vt_address;
+		flags = prm->slt1_flags;
+		seg_offset = prm->slt1_seg_offset;
+	} else {
+		if (prm->slt0_size == 0) {
+			return -ENOENT;
+		}
+		zb_img_conv_u32_version(prm->slt0_ver, &info->version);
+		info->flash_device = area->slt0_fldev;
+		info->hdr_start = area->slt0_offset;
+		info->start = prm->slt0_start;
+		info->end = prm->slt0_start + prm->slt0_size;
+		info->load_address = prm->slt0_vt_address;
+		flags = prm->slt0_flags;
+		seg_offset = prm->slt0_seg_offset;
+	}
+	info->enc_start = info->end;
+	info->seg_offset = info->hdr_start;
+	if ((flags & ZB_PRM_FLAG_SEG) && zb_img_read_seg(info, seg_offset)) {
+		return -EFAULT;
+	}
+	info->is_valid = true;
+	return 0;
+}
+
+int zb_img_check_sect_tbl(zb_img_info *info, off_t eoff)
+{
+	int rc;
+	u8_t hash[HASH_BYTES];
+
+	if (!info->has_sect_hash) {
+		return -EINVAL;
+	}
+
+	rc = zb_hash_flash_type(hash, info->hash_type, info->flash_device,
+				zb_img_sect_tbl_offset(info) + eoff,
+				zb_img_sect_cnt(info) * HASH_BYTES);
+	if (rc) {
+		return rc;
+	}
+
+	if (memcmp(hash, info->sect_root, HASH_BYTES)) {
+		return -EFAULT;
+	}
+	return 0;
+}
+
+int zb_img_check_sect(zb_img_info *info, off_t off, u8_t sect)
+{
+	int rc;
+	u8_t hash[HASH_BYTES], tbl_hash[HASH_BYTES];
+	off_t sect_start, start, end;
+
+	if ((!info->has_sect_hash) || (sect >= zb_img_sect_cnt(info))) {
+		return -EINVAL;
+	}
+
+	rc = zb_flash_read(info->flash_device, zb_img_sect_tbl_offset(info) +
+			   sect * HASH_BYTES, tbl_hash, HASH_BYTES);
+	if (rc) {
+		return rc;
+	}
+
+	/* only the image data in the sector is hashed */
+	sect_start = info->hdr_start + sect * SECTOR_SIZE;
+	start = MAX(info->start, sect_start);
+	end = MAX(start, MIN(info->end, sect_start + SECTOR_SIZE));
+	rc = zb_hash_flash_type(hash, info->hash_type, info->flash_device,
+				off + start - sect_start, end - start);
+	if (rc) {
+		return rc;
+	}
+
+	if (memcmp(hash, tbl_hash, HASH_BYTES)) {
+		return -EFAULT;
+	}
+	return 0;
+}
+
+int zb_img_cmp_restart(zb_img_info *info, u8_t sect, off_t *off)
+{
+	int rc;
+	u32_t soff;
+
+	if ((!info->is_cmp) || (sect >= zb_img_sect_cnt(info))) {
+		return -EINVAL;
+	}
+
+	rc = zb_flash_read(info->flash_device, zb_img_cmp_tbl_offset(info) +
+			   sect * sizeof(u32_t), &soff, sizeof(u32_t));
+	if (rc) {
+		return rc;
+	}
+
+	if (soff > (info->cmp_end - info->cmp_start)) {
+		return -EFAULT;
+	}
+	*off = info->cmp_start + soff;
+	return 0;
+}
+
 int zb_img_calc_crc32(zb_img_info *info, u32_t *crc32)
 {
 	return zb_crc32_flash(crc32, info->flash_device, info->start,
 			      info->end - info->start);
 }
 
+int zb_img_calc_crc32_tbl(struct zb_slt_area *area, zb_img_info *info,
+			  u8_t slt, u32_t *crc32)
+{
+	int rc;
+	u8_t buf[HASH_FLASH_BUFFER_BYTES];
+	off_t off, sect_end;
+	u32_t crc = 0, sect_crc;
+	u32_t sect = 0;
+
+	off = info->start;
+	while (off < info->end) {
+		sect_end = MIN(off + SECTOR_SIZE, info->end);
+		sect_crc = 0;
+		while (off < sect_end) {
+			size_t buf_len = MIN(HASH_FLASH_BUFFER_BYTES,
+					     sect_end - off);
+
+			rc = zb_flash_read(info->flash_device, off, buf,
+					   buf_len);
+			if (rc) {
+				return rc;
+			}
+			crc = crc32_ieee_update(crc, buf, buf_len);
+			sect_crc = crc32_ieee_update(sect_crc, buf, buf_len);
+			off += buf_len;
+		}
+		/* images without room for a table only get the crc */
+		(void)zb_crc_tbl_write(area, slt, sect, sect_crc);
+		sect++;
+	}
+
+	*crc32 = crc;
+	return 0;
+}
+
+int zb_img_calc_sect_crc32(zb_img_info *info, u32_t sect, u32_t *crc32)
+{
+	off_t off;
+
+	off = info->start + sect * SECTOR_SIZE;
+	if (off >= info->end) {
+		return -EINVAL;
+	}
+	return zb_crc32_flash(crc32, info->flash_device, off,
+			      MIN(SECTOR_SIZE, info->end - off));
+}
+
 void zb_img_conv_version_u32(img_ver *ver, u32_t *u32_ver)
 {
 	*u32_ver = (((u32_t)ver->major << 24) | ((u32_t)ver->minor << 16) |
 		    ((u32_t)ver->revision));
 }
 
+void zb_img_conv_u32_version(u32_t u32_ver, img_ver *ver)
+{
+	ver->major = (u8_t)(u32_ver >> 24);
+	ver->minor = (u8_t)(u32_ver >> 16);
+	ver->revision = (u16_t)u32_ver;
+	ver->build = 0;
+}
+
 int zb_img_check(struct zb_slt_area *area, u8_t *slt)
 {
 	int rc = 0;
@@ -163,14 +590,36 @@ int zb_img_check(struct zb_slt_area *area, u8_t *slt)
 
 	img_size = info.end - info.hdr_start;
 
-	if ((*slt == 0) && ((img_size + SECTOR_SIZE) > area->slt0_size)) {
+	/* RAM images are copied completely, they have no segments */
+	if (info.seg_cnt && zb_in_ram(info.load_address)) {
 		return -EFAULT;
 	}
-	if ((*slt == 1) && ((img_size + SECTOR_SIZE) > area->slt1_size)) {
+
+	/* compressed images are only expanded by a swap to slot 0 */
+	if (info.is_cmp && ((*slt == 1) || zb_in_ram(info.load_address) ||
+			    ((zb_img_cmp_tbl_end(&info) - info.hdr_start) >
+			     area->slt1_size))) {
+		return -EFAULT;
+	}
+
+	/* the last sector is used by the move up */
+	if ((*slt == 0) &&
+	    ((img_size + zb_sector_last(area, 0)) > area->slt0_size)) {
+		return -EFAULT;
+	}
+	if ((*slt == 1) &&
+	    ((img_size + zb_sector_last(area, 1)) > area->slt1_size)) {
 		return -EFAULT;
 	}
 
 	rc = zb_prm_read(area, &prm);
+
+	/* a delta image is only accepted for the base image in slot 0 */
+	if (info.is_delta && (rc || (prm.slt0_ver != info.base_ver) ||
+			      (prm.slt0_crc32 != info.base_crc32))) {
+		return -EFAULT;
+	}
+
 	if (rc == -ENOENT) {
 		return 0;
 	}
@@ -5,9 +5,12 @@
  */
 
 #include <zephyr.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
+#include <crc.h>
 
+#include "../include/zb_tlv.h"
 #include "../include/zb_move.h"
 
 #include <logging/log.h>
@@ -15,29 +18,191 @@ LOG_MODULE_REGISTER(zb_move);
 
 int zb_img_move(zb_move_cmd *mcmd, size_t len, bool to_ram);
 
-int zb_sector_erase(zb_img_info *info, off_t offset)
+/* per sector crc32 collected during a swap, same layout as the crc table. The
+ * crc table uses at most half of slt0end (SECTOR_SIZE / 8 entries) and the
+ * sector index is a u8_t, so there are at most 256 sectors for each slot.
+ */
+#define ZB_SWP_CRC_TBL_CNT MIN(SECTOR_SIZE / 8, 2 * 256)
+static u32_t zb_swp_crc_tbl[ZB_SWP_CRC_TBL_CNT];
+
+static void zb_crc_acc_init(zb_crc_acc *acc, off_t start, off_t end,
+			    u32_t *tbl)
+{
+	acc->start = start;
+	acc->end = end;
+	acc->off = start;
+	acc->crc32 = 0;
+	acc->sect_crc32 = 0;
+	acc->tbl = tbl;
+	acc->sect = 0;
+	acc->valid = true;
+	acc->hash = false;
+}
+
+/* Prepare the accumulator for image img that is swapped to base */
+static void zb_crc_acc_init_swp(zb_crc_acc *acc, zb_img_info *img, off_t base,
+				u32_t *tbl)
+{
+	zb_crc_acc_init(acc, base + img->start - img->hdr_start,
+			base + img->end - img->hdr_start, tbl);
+	acc->valid = img->is_valid;
+}
+
+/* Add data written to the destination at off to the crc32, the data has to
+ * arrive in order, otherwise (e.g. a swap resumed after power fail) the
+ * accumulator is invalidated and the crc32 is calculated from flash.
+ */
+static void zb_crc_acc_update(zb_crc_acc *acc, off_t off, const u8_t *buf,
+			      size_t len)
+{
+	size_t chunk;
+	off_t sect_end;
+
+	if ((!acc->valid) || ((off + (off_t)len) <= acc->start) ||
+	    (off >= acc->end)) {
+		return;
+	}
+
+	if (off < acc->start) {
+		/* skip the header */
+		buf += acc->start - off;
+		len -= acc->start - off;
+		off = acc->start;
+	}
+
+	if (off != acc->off) {
+		acc->valid = false;
+		return;
+	}
+
+	len = MIN(len, acc->end - off);
+	while (len) {
+		sect_end = MIN(acc->start + (acc->sect + 1) * SECTOR_SIZE,
+			       acc->end);
+		chunk = MIN(len, sect_end - off);
+		acc->crc32 = crc32_ieee_update(acc->crc32, buf, chunk);
+		acc->sect_crc32 = crc32_ieee_update(acc->sect_crc32, buf,
+						    chunk);
+		if (acc->hash) {
+			(void)zb_hash_update(&acc->hctx, buf, chunk);
+		}
+		buf += chunk;
+		len -= chunk;
+		off += chunk;
+		if (off == sect_end) {
+			if (acc->tbl) {
+				acc->tbl[acc->sect] = acc->sect_crc32;
+			}
+			acc->sect_crc32 = 0;
+			acc->sect++;
+		}
+	}
+	acc->off = off;
+}
+
+/* Get the crc32 of a image after swap and write the crc table, the crc32
+ * accumulated during the swap is used when it covers the complete image.
+ */
+static void zb_img_swp_crc32(struct zb_slt_area *area, zb_img_info *info,
+			     zb_crc_acc *acc, u8_t slt, u32_t *crc32)
+{
+	u8_t sect;
+
+	if ((!acc->valid) || (acc->off != acc->end) ||
+	    (acc->start != info->start) || (acc->end != info->end)) {
+		(void)zb_img_calc_crc32_tbl(area, info, slt, crc32);
+		return;
+	}
+
+	LOG_INF("Using crc32 calculated during swap");
+	if (acc->tbl) {
+		for (sect = 0; sect < acc->sect; sect++) {
+			(void)zb_crc_tbl_write(area, slt, sect,
+					       acc->tbl[sect]);
+		}
+	}
+	*crc32 = acc->crc32;
+}
+
+/* Check the hash of the unencrypted image after swap (when available), the
+ * hash accumulated during the swap is used when it covers the complete image.
+ */
+static int zb_img_swp_phash(zb_img_info *info, zb_crc_acc *acc)
+{
+	u8_t hash[HASH_BYTES];
+	int rc;
+
+	if ((!info->has_phash) || zb_in_ram(info->load_address)) {
+		/* RAM images remain encrypted in flash */
+		return 0;
+	}
+
+	if (acc->hash && acc->valid && (acc->off == acc->end) &&
+	    (acc->start == info->start) && (acc->end == info->end)) {
+		rc = zb_hash_final(hash, &acc->hctx);
+	} else {
+		rc = zb_hash_flash_type(hash, info->hash_type,
+					info->flash_device, info->start,
+					info->end - info->start);
+	}
+
+	if (rc || memcmp(hash, info->phash, HASH_BYTES)) {
+		LOG_ERR("Unencrypted image hash mismatch");
+		return -EBADMSG;
+	}
+	return 0;
+}
+
+/* Move the image location from one slot to the other, used when the header of
+ * a image that is being swapped has already been moved to the other slot.
+ */
+static void zb_img_info_rebase(zb_img_info *info, off_t from, off_t to,
+			       struct device *fl_dev)
+{
+	info->hdr_start += to - from;
+	info->start += to - from;
+	info->enc_start += to - from;
+	info->end += to - from;
+	info->cmp_start += to - from;
+	info->cmp_end += to - from;
+	info->flash_device = fl_dev;
+}
+
+int zb_sector_erase(zb_img_info *info, off_t offset, size_t size)
 {
 	return zb_flash_erase(info->flash_device, info->hdr_start + offset,
-			      SECTOR_SIZE);
+			      size);
 }
 
+/* nxtoff is the offset of the sector after secoff (secoff + SECTOR_SIZE for
+ * uniform sectors)
+ */
 void set_mcmd_moveup(zb_move_cmd *mcmd, zb_img_swp_info *swp_info,
-		     off_t secoff) {
+		     off_t secoff, off_t nxtoff) {
 	mcmd->fr_off = swp_info->to.hdr_start + secoff;
-	mcmd->fr_eoff = mcmd->fr_off + SECTOR_SIZE;
+	mcmd->fr_eoff = swp_info->to.hdr_start + nxtoff;
 	mcmd->fl_dev_fr = swp_info->to.flash_device;
-	mcmd->to_off = swp_info->to.hdr_start + secoff + SECTOR_SIZE;
+	mcmd->to_off = swp_info->to.hdr_start + nxtoff;
 	mcmd->fl_dev_to = swp_info->to.flash_device;
+	mcmd->key = swp_info->to.enc_key;
+	mcmd->enc_type = swp_info->to.enc_type;
+	mcmd->mark = 0U;
+	mcmd->acc = NULL;
 }
 
 void set_mcmd_swp_p2(zb_move_cmd *mcmd, zb_img_swp_info *swp_info,
-		     off_t secoff) {
-	mcmd->fr_off = swp_info->to.hdr_start + secoff + SECTOR_SIZE;
-	mcmd->fr_eoff = swp_info->to.enc_start + SECTOR_SIZE;
+		     off_t secoff, off_t nxtoff) {
+	mcmd->fr_off = swp_info->to.hdr_start + nxtoff;
+	mcmd->fr_eoff = swp_info->to.enc_start + nxtoff - secoff;
 	mcmd->fl_dev_fr = swp_info->to.flash_device;
 	mcmd->to_off = swp_info->fr.hdr_start + secoff;
 	mcmd->fl_dev_to = swp_info->fr.flash_device;
 	mcmd->key = swp_info->to.enc_key;
+	mcmd->enc_type = swp_info->to.enc_type;
+	/* a compressed image is stored expanded in slt1 */
+	mcmd->mark = ((secoff == 0) && swp_info->to.has_cmp) ?
+		     TLVA_TYPE_EXPANDED : 0U;
+	mcmd->acc = &swp_info->crc[1];
 }
 
 void set_mcmd_swp_p1(zb_move_cmd *mcmd, zb_img_swp_info *swp_info,
@@ -48,41 +213,569 @@ void set_mcmd_swp_p1(zb_move_cmd *mcmd, zb_img_swp_info *swp_info,
 	mcmd->to_off = swp_info->to.hdr_start + secoff;
 	mcmd->fl_dev_to = swp_info->to.flash_device;
 	mcmd->key = swp_info->fr.enc_key;
+	mcmd->enc_type = swp_info->fr.enc_type;
+	mcmd->mark = 0U;
+	mcmd->acc = &swp_info->crc[0];
+}
+
+void set_mcmd_scr_p1(zb_move_cmd *mcmd, zb_img_swp_info *swp_info,
+		     struct zb_slt_area *area, off_t secoff) {
+	mcmd->fr_off = swp_info->fr.hdr_start + secoff;
+	mcmd->fr_eoff = mcmd->fr_off + SECTOR_SIZE;
+	mcmd->fl_dev_fr = swp_info->fr.flash_device;
+	mcmd->to_off = zb_scratch_offset(area, swp_info->scr_start,
+					 secoff / SECTOR_SIZE);
+	mcmd->fl_dev_to = area->swpstat_fldev;
+	mcmd->key = swp_info->fr.enc_key;
+	mcmd->enc_type = swp_info->fr.enc_type;
+	mcmd->mark = 0U;
+	mcmd->acc = NULL;
+}
+
+/* the scratch sector is decrypted as if it were at secoff in the image */
+void set_mcmd_scr_p2(zb_move_cmd *mcmd, zb_img_swp_info *swp_info,
+		     struct zb_slt_area *area, off_t secoff) {
+	mcmd->fr_off = zb_scratch_offset(area, swp_info->scr_start,
+					 secoff / SECTOR_SIZE);
+	mcmd->fr_eoff = mcmd->fr_off - secoff + swp_info->fr.enc_start -
+			swp_info->fr.hdr_start;
+	mcmd->fl_dev_fr = area->swpstat_fldev;
+	mcmd->to_off = swp_info->fr.hdr_start + secoff;
+	mcmd->fl_dev_to = swp_info->fr.flash_device;
+	mcmd->key = swp_info->fr.enc_key;
+	mcmd->enc_type = swp_info->fr.enc_type;
+	mcmd->mark = 0U;
+	mcmd->acc = &swp_info->crc[1];
+}
+
+/* Input buffer size used to expand compressed images, the buffer is decrypted
+ * at once so it has to be a multiple of AES_BLOCK_SIZE.
+ */
+#define UNPACK_IN_BYTES 128
+
+/* state while a sector of a compressed image is expanded */
+typedef struct {
+	zb_move_cmd *mcmd;
+	off_t in_start;	  /* start of the stream */
+	off_t in_end;	  /* end of the stream */
+	off_t in_off;	  /* location of in[0] */
+	size_t in_len;
+	size_t in_pos;
+	off_t out_start;  /* destination of the expanded image start */
+	u32_t out_pos;	  /* image position after the data in out */
+	size_t out_len;
+	bool enc;
+	struct zb_chacha20_ctx cctx;
+	off_t secoff;	  /* offset of the sector that is expanded */
+	zb_img_info *base; /* base image of a delta image (in slot 0) */
+	struct device *base_dev; /* location of the swapped base sectors */
+	off_t base_off;
+	u8_t in[UNPACK_IN_BYTES];
+	u8_t out[MOVE_BLOCK_SIZE];
+} zb_unpack;
+
+/* Decrypt len bytes of data that is encrypted from offset 0, off is the
+ * offset of buf[0] (a multiple of AES_BLOCK_SIZE for AES).
+ */
+static int zb_unpack_decrypt(u8_t *buf, size_t len, u32_t off,
+			     const u8_t *key, u8_t enc_type,
+			     struct zb_chacha20_ctx *cctx)
+{
+	u8_t ctr[AES_BLOCK_SIZE] = {0U};
+	u32_t blk;
+
+	if (enc_type == ENC_TYPE_CHACHA20) {
+		zb_chacha20_seek(cctx, off);
+		zb_chacha20_xor(cctx, buf, len);
+		return 0;
+	}
+
+	blk = off / AES_BLOCK_SIZE;
+	ctr[AES_BLOCK_SIZE - 4] = (blk >> 24) & 0xff;
+	ctr[AES_BLOCK_SIZE - 3] = (blk >> 16) & 0xff;
+	ctr[AES_BLOCK_SIZE - 2] = (blk >> 8) & 0xff;
+	ctr[AES_BLOCK_SIZE - 1] = blk & 0xff;
+	return zb_aes_ctr_mode(buf, len, ctr, key);
+}
+
+/* Read and decrypt the next part of the stream */
+static int zb_unpack_fill(zb_unpack *up)
+{
+	size_t len;
+	int rc;
+
+	up->in_off += up->in_len;
+	up->in_pos = 0;
+	up->in_len = 0;
+	if (up->in_off >= up->in_end) {
+		return -EFAULT;
+	}
+
+	len = MIN(UNPACK_IN_BYTES, up->in_end - up->in_off);
+	rc = zb_flash_read(up->mcmd->fl_dev_fr, up->in_off, up->in, len);
+	if (rc) {
+		return rc;
+	}
+	up->in_len = len;
+
+	if (!up->enc) {
+		return 0;
+	}
+
+	/* the stream is encrypted from its start */
+	return zb_unpack_decrypt(up->in, len, up->in_off - up->in_start,
+				 up->mcmd->key, up->mcmd->enc_type, &up->cctx);
+}
+
+static int zb_unpack_getb(zb_unpack *up, u8_t *b)
+{
+	int rc;
+
+	if (up->in_pos >= up->in_len) {
+		rc = zb_unpack_fill(up);
+		if (rc) {
+			return rc;
+		}
+	}
+	*b = up->in[up->in_pos++];
+	return 0;
+}
+
+/* Add the length extension bytes of a token field */
+static int zb_unpack_len(zb_unpack *up, u32_t *len)
+{
+	u8_t b;
+	int rc;
+
+	do {
+		rc = zb_unpack_getb(up, &b);
+		if (rc) {
+			return rc;
+		}
+		*len += b;
+	} while ((b == 0xff) && (*len <= SECTOR_SIZE));
+	return 0;
+}
+
+/* Write the expanded data to the destination */
+static int zb_unpack_flush(zb_unpack *up)
+{
+	off_t to_off = up->out_start + up->out_pos - up->out_len;
+	int rc;
+
+	if (!up->out_len) {
+		return 0;
+	}
+
+	rc = zb_flash_write(up->mcmd->fl_dev_to, to_off, up->out, up->out_len);
+	if (rc) {
+		return rc;
+	}
+
+	if (up->mcmd->acc) {
+		zb_crc_acc_update(up->mcmd->acc, to_off, up->out, up->out_len);
+	}
+	up->out_len = 0;
+	return 0;
+}
+
+static int zb_unpack_put(zb_unpack *up, u8_t b)
+{
+	up->out[up->out_len++] = b;
+	up->out_pos++;
+	if (up->out_len == MOVE_BLOCK_SIZE) {
+		return zb_unpack_flush(up);
+	}
+	return 0;
+}
+
+/* Copy a match, data that is no longer in the output buffer is read back from
+ * the destination.
+ */
+static int zb_unpack_copy(zb_unpack *up, u32_t dist, u32_t len)
+{
+	u32_t src = up->out_pos - dist, buf_start;
+	size_t n;
+	int rc;
+
+	while (len) {
+		buf_start = up->out_pos - up->out_len;
+		if (src >= buf_start) {
+			rc = zb_unpack_put(up, up->out[src - buf_start]);
+			src++;
+			len--;
+		} else {
+			n = MIN(len, buf_start - src);
+			n = MIN(n, MOVE_BLOCK_SIZE - up->out_len);
+			rc = zb_flash_read(up->mcmd->fl_dev_to,
+					   up->out_start + src,
+					   &up->out[up->out_len], n);
+			if (rc) {
+				return rc;
+			}
+			up->out_len += n;
+			up->out_pos += n;
+			src += n;
+			len -= n;
+			if (up->out_len == MOVE_BLOCK_SIZE) {
+				rc = zb_unpack_flush(up);
+			}
+		}
+		if (rc) {
+			return rc;
+		}
+	}
+	return 0;
+}
+
+/* Copy a match from the base image of a delta image. The base image sectors
+ * before the sector that is expanded are already swapped to slot 1 (and
+ * encrypted again for a encrypted base image), the other sectors are still
+ * in slot 0 (moved up by one sector).
+ */
+static int zb_unpack_base(zb_unpack *up, u32_t boff, u32_t len)
+{
+	zb_img_info *base = up->base;
+	struct zb_chacha20_ctx cctx;
+	u8_t blk[AES_BLOCK_SIZE];
+	off_t src, enc_off, blk_off;
+	size_t n;
+	bool enc;
+	int rc;
+
+	if ((boff > (base->end - base->start)) ||
+	    (len > (base->end - base->start - boff))) {
+		return -EFAULT;
+	}
+
+	src = base->start - base->hdr_start + boff;
+	enc_off = base->enc_start - base->hdr_start;
+	enc = (base->enc_start != base->end);
+	if (enc && (base->enc_type == ENC_TYPE_CHACHA20)) {
+		zb_chacha20_init(&cctx, base->enc_key, NULL);
+	}
+
+	while (len) {
+		n = MIN(len, MOVE_BLOCK_SIZE - up->out_len);
+		if (src >= up->secoff) {
+			rc = zb_flash_read(base->flash_device,
+					   base->hdr_start + src + SECTOR_SIZE,
+					   &up->out[up->out_len], n);
+		} else if ((!enc) || (src < enc_off)) {
+			n = MIN(n, up->secoff - src);
+			if (enc) {
+				n = MIN(n, enc_off - src);
+			}
+			rc = zb_flash_read(up->base_dev, up->base_off + src,
+					   &up->out[up->out_len], n);
+		} else {
+			blk_off = enc_off +
+				  ((src - enc_off) & ~(AES_BLOCK_SIZE - 1));
+			n = MIN(n, blk_off + AES_BLOCK_SIZE - src);
+			n = MIN(n, up->secoff - src);
+			rc = zb_flash_read(up->base_dev, up->base_off + blk_off,
+					   blk, AES_BLOCK_SIZE);
+			if (!rc) {
+				rc = zb_unpack_decrypt(blk, AES_BLOCK_SIZE,
+						       blk_off - enc_off,
+						       base->enc_key,
+						       base->enc_type, &cctx);
+			}
+			if (!rc) {
+				memcpy(&up->out[up->out_len],
+				       &blk[src - blk_off], n);
+			}
+		}
+		if (rc) {
+			return rc;
+		}
+		up->out_len += n;
+		up->out_pos += n;
+		src += n;
+		len -= n;
+		if (up->out_len == MOVE_BLOCK_SIZE) {
+			rc = zb_unpack_flush(up);
+			if (rc) {
+				return rc;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Expand a sector of a compressed image (swp_info->fr) to its destination.
+ * The stream location of each sector is taken from the restart table, so a
+ * interrupted sector is simply expanded again. All RAM used is in zb_unpack.
+ */
+static int zb_img_unpack(zb_move_cmd *mcmd, zb_img_swp_info *swp_info,
+			 off_t secoff, size_t len)
+{
+	zb_unpack up;
+	zb_move_cmd hcmd;
+	zb_img_info *info = &swp_info->fr;
+	off_t in_off, img_off = info->start - info->hdr_start;
+	u32_t end, lit, mlen, dist, boff = 0U;
+	u8_t token, b;
+	int rc, i;
+
+	if (secoff < img_off) {
+		/* the header is not compressed */
+		hcmd = *mcmd;
+		hcmd.fr_eoff = mcmd->fr_off + img_off - secoff;
+		rc = zb_img_move(&hcmd, MIN(len, img_off - secoff), false);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	if ((secoff + (off_t)len) <= img_off) {
+		return 0;
+	}
+
+	rc = zb_img_cmp_restart(info, secoff / SECTOR_SIZE, &in_off);
+	if (rc) {
+		return rc;
+	}
+
+	/* the stream data of earlier sectors is overwritten during the swap */
+	if ((in_off - info->hdr_start) < secoff) {
+		return -EFAULT;
+	}
+
+	up.mcmd = mcmd;
+	up.in_start = info->cmp_start;
+	up.in_end = info->cmp_end;
+	up.in_off = info->cmp_start +
+		    ((in_off - info->cmp_start) & ~(AES_BLOCK_SIZE - 1));
+	up.in_len = 0;
+	up.secoff = secoff;
+	up.base = &swp_info->to;
+	up.base_dev = info->flash_device;
+	up.base_off = info->hdr_start;
+	up.enc = (info->enc_start != info->end);
+	if (up.enc && (mcmd->enc_type == ENC_TYPE_CHACHA20)) {
+		zb_chacha20_init(&up.cctx, mcmd->key, NULL);
+	}
+	rc = zb_unpack_fill(&up);
+	if (rc) {
+		return rc;
+	}
+	up.in_pos = in_off - up.in_off;
+
+	up.out_start = mcmd->to_off - secoff + img_off;
+	up.out_pos = MAX(secoff - img_off, 0);
+	up.out_len = 0;
+	end = secoff + len - img_off;
+
+	while (up.out_pos < end) {
+		rc = zb_unpack_getb(&up, &token);
+		if (rc) {
+			return rc;
+		}
+
+		lit = token >> 4;
+		if (lit == 0x0f) {
+			rc = zb_unpack_len(&up, &lit);
+			if (rc) {
+				return rc;
+			}
+		}
+		if (lit > (end - up.out_pos)) {
+			return -EFAULT;
+		}
+		while (lit--) {
+			rc = zb_unpack_getb(&up, &b);
+			if (!rc) {
+				rc = zb_unpack_put(&up, b);
+			}
+			if (rc) {
+				return rc;
+			}
+		}
+
+		if (up.out_pos == end) {
+			/* the last sequence of a sector has no match */
+			break;
+		}
+
+		rc = zb_unpack_getb(&up, &b);
+		dist = b;
+		if (!rc) {
+			rc = zb_unpack_getb(&up, &b);
+		}
+		if (rc) {
+			return rc;
+		}
+		dist |= (u32_t)b << 8;
+
+		if (dist == 0) {
+			/* a match in the base image of a delta image */
+			if (!info->is_delta) {
+				return -EFAULT;
+			}
+			boff = 0U;
+			for (i = 0; i < 4; i++) {
+				rc = zb_unpack_getb(&up, &b);
+				if (rc) {
+					return rc;
+				}
+				boff |= (u32_t)b << (8 * i);
+			}
+		}
+
+		mlen = token & 0x0f;
+		if (mlen == 0x0f) {
+			rc = zb_unpack_len(&up, &mlen);
+			if (rc) {
+				return rc;
+			}
+		}
+		mlen += 4;
+		if ((dist > up.out_pos) || (mlen > (end - up.out_pos))) {
+			return -EFAULT;
+		}
+
+		if (dist == 0) {
+			rc = zb_unpack_base(&up, boff, mlen);
+		} else {
+			rc = zb_unpack_copy(&up, dist, mlen);
+		}
+		if (rc) {
+			return rc;
+		}
+	}
+
+	return zb_unpack_flush(&up);
 }
 
-int zb_img_cmd_proc_p3_wrt(struct zb_slt_area *area, struct zb_cmd cmd)
+/* Check a sector of the installed image before it is moved, a mismatch is
+ * kept in the swap status (CMD1_MASK_SECT_ERR) and the image is rejected at
+ * the end of the swap.
+ */
+static int zb_img_swp_sect_chk(zb_img_swp_info *swp_info, off_t off,
+			       u8_t sect)
 {
-	u32_t crc32;
+	if (!swp_info->fr.has_sect_hash) {
+		return 0;
+	}
+
+	if (swp_info->sect_err ||
+	    zb_img_check_sect(&swp_info->fr, off, sect)) {
+		LOG_ERR("Sector %d hash mismatch", sect);
+		return -EFAULT;
+	}
+	return 0;
+}
+
+/* Check all sectors of a unencrypted image that stays in slot 1, the check of
+ * the image before the swap only verifies the sector hash table
+ */
+static int zb_img_swp_inplace_chk(struct zb_slt_area *area,
+				  zb_img_swp_info *swp_info)
+{
+	zb_img_info *info = &swp_info->fr;
+	int sect, cnt;
+
+	cnt = zb_sector_cnt(area, info->end - info->hdr_start);
+	for (sect = 0; sect < cnt; sect++) {
+		if (zb_img_swp_sect_chk(swp_info,
+					info->hdr_start + sect * SECTOR_SIZE,
+					sect)) {
+			return -EFAULT;
+		}
+	}
+	return 0;
+}
+
+int zb_img_cmd_proc_p3_wrt(struct zb_slt_area *area, struct zb_cmd cmd,
+			   zb_img_swp_info *swp_info)
+{
+	u32_t crc32, ver;
 	zb_img_info info;
 	struct zb_prm prm;
+	bool inplace, sect_err, rejected = false;
+	int sect_cnt = 0;
+
+	prm.prm_ver = ZB_PRM_VERSION;
+	inplace = ((cmd.cmd2 & CMD2_MASK_INPLACE) != 0);
+	sect_err = ((cmd.cmd1 & CMD1_MASK_SECT_ERR) != 0);
+	cmd.cmd1 &= ~CMD1_MASK_SECT_ERR;
 
 	zb_img_get_info_nsc(&info, area, 0, 0, false);
-	zb_img_calc_crc32(&info, &crc32);
+	zb_img_swp_crc32(area, &info, &swp_info->crc[0], 0, &crc32);
 	prm.slt0_crc32 = crc32;
-	zb_img_conv_version_u32(&info.version, &prm.slt0_ver);
+	if ((!inplace) &&
+	    (sect_err || zb_img_swp_phash(&info, &swp_info->crc[0]))) {
+		/* the rejected image will not pass the boot verification */
+		prm.slt0_crc32 = ~crc32;
+		rejected = true;
+	}
+	/* zb_prm is packed, its members can't be passed by address */
+	zb_img_conv_version_u32(&info.version, &ver);
+	prm.slt0_ver = ver;
 	prm.sec_ld_address = info.load_address;
 	prm.pri_ld_address = info.load_address;
+	prm.slt0_start = info.start;
+	prm.slt0_size = info.end - info.start;
+	prm.slt0_vt_address = info.load_address;
+	prm.slt0_flags = (info.enc_start != info.end) ? ZB_PRM_FLAG_ENC : 0;
+	prm.slt0_flags |= info.seg_cnt ? ZB_PRM_FLAG_SEG : 0;
+	prm.slt0_seg_offset = info.seg_offset;
+	if (!inplace) {
+		sect_cnt = zb_sector_cnt(area, info.end - info.hdr_start);
+	}
 
 	zb_img_get_info_nsc(&info, area, 1, 0, false);
 	if (info.is_valid) {
-		zb_img_calc_crc32(&info, &crc32);
+		zb_img_swp_crc32(area, &info, &swp_info->crc[1], 1, &crc32);
 		prm.slt1_crc32 = crc32;
-		zb_img_conv_version_u32(&info.version, &prm.slt1_ver);
-		if (cmd.cmd2 & CMD2_MASK_INPLACE) {
+		if (inplace &&
+		    (sect_err || zb_img_swp_phash(&info, &swp_info->crc[1]))) {
+			prm.slt1_crc32 = ~crc32;
+			rejected = true;
+		}
+		zb_img_conv_version_u32(&info.version, &ver);
+		prm.slt1_ver = ver;
+		prm.slt1_start = info.start;
+		prm.slt1_size = info.end - info.start;
+		prm.slt1_vt_address = info.load_address;
+		prm.slt1_flags = (info.enc_start != info.end) ?
+				 ZB_PRM_FLAG_ENC : 0;
+		prm.slt1_flags |= info.seg_cnt ? ZB_PRM_FLAG_SEG : 0;
+		prm.slt1_seg_offset = info.seg_offset;
+		if (inplace) {
+			sect_cnt = zb_sector_cnt(area,
+						 info.end - info.hdr_start);
 			prm.pri_ld_address = info.load_address;
+		} else if (rejected) {
+			/* restore the previous image */
+			cmd.cmd1 &= ~CMD1_MASK_SWP_PERM;
 		}
 	} else {
 		prm.slt1_crc32 = 0xffffffff;
 		prm.slt1_ver = 0;
+		prm.slt1_start = info.hdr_start;
+		prm.slt1_size = 0;
+		prm.slt1_vt_address = info.hdr_start;
+		prm.slt1_flags = 0;
+		prm.slt1_seg_offset = info.hdr_start;
 		if (!(cmd.cmd1 & CMD1_MASK_SWP_PERM)) {
 			/* disable restore of bad image/no image */
 			cmd.cmd1 |= CMD1_MASK_SWP_PERM;
 		}
 	}
+	/* the next upgrade continues the scratch rotation after the sectors
+	 * of the installed image (a pre-decryption or scratch pass uses one
+	 * scratch sector for each of them)
+	 */
+	prm.scr_start = swp_info->scr_start + sect_cnt;
 	/* write the information to last sector of slt0 */
 	zb_prm_write(area, &prm);
 	/* write the executed swap command to slt0end */
 	zb_cmd_write_slt0end(area, &cmd);
+	if (rejected) {
+		return -EBADMSG;
+	}
 	return 0;
 }
 
@@ -91,23 +784,63 @@ int zb_img_cmd_proc_p4_wrt(struct zb_slt_area *area, struct zb_cmd cmd)
 	return 0;
 }
 
+/* The scratch rotation start is written in cmd3 of the start command (only
+ * the start modulo scratch_cnt is used) so a resumed swap keeps using it.
+ */
+static u8_t zb_img_scr_start(struct zb_slt_area *area)
+{
+	if (!area->scratch_cnt) {
+		return 0U;
+	}
+	return zb_scratch_start(area) % area->scratch_cnt;
+}
+
+static u32_t zb_img_scr_start_read(struct zb_slt_area *area)
+{
+	struct zb_cmd cmd;
+
+	if (zb_cmd_read_swpstat_first(area, &cmd) ||
+	    ((cmd.cmd2 & ~CMD2_MASK_INPLACE) != CMD2_SWP_START)) {
+		return 0U;
+	}
+	return cmd.cmd3;
+}
+
 int zb_get_img_swp_info(zb_img_swp_info *swp_info, struct zb_cmd cmd,
 			struct zb_slt_area *area)
 {
 	u8_t slt0 = 0U, slt1 = 1;
 	off_t eoff = 0U;
+	u32_t *tbl0 = NULL, *tbl1 = NULL;
+	size_t sect0;
+	zb_crc_acc *acc;
+	bool fr_hdr_moved = false, to_hdr_moved = false, scr_hdr = false;
+	struct zb_slt_area scr_area, *rd_area = area;
+	off_t fr_eoff = 0U;
 
 	LOG_INF("Request image info for move");
 
+	/* the start command holds the scratch rotation start, the zb_prm it
+	 * was read from is replaced in phase 3
+	 */
+	swp_info->scr_start = zb_img_scr_start_read(area);
+
 	if (((cmd.cmd2 & ~CMD2_MASK_INPLACE) == CMD2_SWP_P1) ||
 	    ((cmd.cmd2 & ~CMD2_MASK_INPLACE) == CMD2_SWP_P2)) {
 		if (cmd.cmd3 == 0) {
 			/* During the header swap the header in the to sector is
-		 	 * moved up by one sector */
-			eoff = SECTOR_SIZE;
+		 	 * moved up by one sector, the fr header is moved to
+			 * slt0 in phase 1 */
+			eoff = zb_sector_offset(area, 1, NULL);
+			if ((cmd.cmd2 & ~CMD2_MASK_INPLACE) == CMD2_SWP_P2) {
+				slt1 = 0U;
+				fr_hdr_moved = true;
+			}
 		} else {
 			slt0 = 1;
 			slt1 = 0U;
+			fr_hdr_moved = true;
+			to_hdr_moved = true;
 		}
 	}
 
@@ -115,13 +848,52 @@ int zb_get_img_swp_info(zb_img_swp_info *swp_info, struct zb_cmd cmd,
 		slt0 = 1;
 		slt1 = 1;
 		eoff = 0U;
+		fr_hdr_moved = false;
+		to_hdr_moved = false;
+		if (((cmd.cmd2 & ~CMD2_MASK_INPLACE) == CMD2_SWP_P2) &&
+		    (cmd.cmd3 == 0)) {
+			/* the header is in the moved up sector */
+			eoff = zb_sector_offset(area, 1, NULL);
+		}
+		if (((cmd.cmd2 & ~CMD2_MASK_INPLACE) == CMD2_SCR_P2) &&
+		    (cmd.cmd3 == 0)) {
+			/* the header is in scratch while sector 0 is
+			 * decrypted
+			 */
+			scr_area = *area;
+			scr_area.slt1_offset =
+				zb_scratch_offset(area, swp_info->scr_start, 0);
+			scr_area.slt1_fldev = area->swpstat_fldev;
+			rd_area = &scr_area;
+			scr_hdr = true;
+		}
+		fr_eoff = eoff;
 	}
 
-	zb_img_get_info_nsc(&swp_info->to, area, slt0, eoff, 0);
+	zb_img_get_info_nsc(&swp_info->to, rd_area, slt0,
+			    to_hdr_moved ? 0 : eoff, 0);
+	if (to_hdr_moved) {
+		/* the image data that remains to be moved is in slt0 */
+		zb_img_info_rebase(&swp_info->to, area->slt1_offset,
+				   area->slt0_offset, area->slt0_fldev);
+	}
+	if (scr_hdr) {
+		zb_img_info_rebase(&swp_info->to, scr_area.slt1_offset,
+				   area->slt1_offset, area->slt1_fldev);
+	}
 	LOG_INF("SWP info to [off %zx start %zx eoff %zx end %zx]",
 		swp_info->to.hdr_start, swp_info->to.start,
 		swp_info->to.enc_start, swp_info->to.end);
-	zb_img_get_info_nsc(&swp_info->fr, area, slt1, eoff, 0);
+	zb_img_get_info_nsc(&swp_info->fr, rd_area, slt1, fr_eoff, 0);
+	if (fr_hdr_moved) {
+		/* the image data that remains to be moved is in slt1 */
+		zb_img_info_rebase(&swp_info->fr, area->slt0_offset,
+				   area->slt1_offset, area->slt1_fldev);
+	}
+	if (scr_hdr) {
+		zb_img_info_rebase(&swp_info->fr, scr_area.slt1_offset,
+				   area->slt1_offset, area->slt1_fldev);
+	}
 	LOG_INF("SWP info fr [off %zx start %zx eoff %zx end %zx]",
 		swp_info->fr.hdr_start, swp_info->fr.start,
 		swp_info->fr.enc_start, swp_info->fr.end);
@@ -136,193 +908,407 @@ int zb_get_img_swp_info(zb_img_swp_info *swp_info, struct zb_cmd cmd,
 		swp_info->to.enc_start = swp_info->to.end;
 	}
 
+	/* keep the per sector crc32 when the crc table fits */
+	sect0 = area->slt0_size / SECTOR_SIZE;
+	if ((sect0 + area->slt1_size / SECTOR_SIZE) <=
+	    ARRAY_SIZE(zb_swp_crc_tbl)) {
+		tbl0 = zb_swp_crc_tbl;
+		tbl1 = &zb_swp_crc_tbl[sect0];
+	}
+
+	if (cmd.cmd2 & CMD2_MASK_INPLACE) {
+		/* slt0 is not changed by a inplace swap */
+		zb_crc_acc_init_swp(&swp_info->crc[0], &swp_info->to,
+				    area->slt0_offset, tbl0);
+		swp_info->crc[0].valid = false;
+		zb_crc_acc_init_swp(&swp_info->crc[1], &swp_info->fr,
+				    area->slt1_offset, tbl1);
+	} else {
+		zb_crc_acc_init_swp(&swp_info->crc[0], &swp_info->fr,
+				    area->slt0_offset, tbl0);
+		zb_crc_acc_init_swp(&swp_info->crc[1], &swp_info->to,
+				    area->slt1_offset, tbl1);
+	}
+
+	/* sector hashes of the installed image are checked during the move,
+	 * (re)check the table (the tlv area is checked by zb_img_check before
+	 * the swap starts)
+	 */
+	swp_info->sect_err = false;
+	if (swp_info->fr.has_sect_hash &&
+	    zb_img_check_sect_tbl(&swp_info->fr, 0)) {
+		LOG_ERR("Sector hash table invalid");
+		swp_info->sect_err = true;
+	}
+
+	/* the installed image is hashed while it is moved (decrypted) */
+	acc = &swp_info->crc[(cmd.cmd2 & CMD2_MASK_INPLACE) ? 1 : 0];
+	if (swp_info->fr.has_phash && (!zb_in_ram(swp_info->fr.load_address)) &&
+	    (!zb_hash_init(&acc->hctx, swp_info->fr.hash_type))) {
+		acc->hash = true;
+	}
+
 	swp_info->loaded = true;
 
 	return 0;
 }
 
-int zb_img_cmd_proc(zb_img_swp_info *info, struct zb_slt_area *area) {
+/* Remaining steps (estimate) of a swap that continues with cmd */
+static void zb_img_swp_progress(struct zb_slt_area *area,
+				zb_img_swp_step *step, struct zb_cmd *cmd)
+{
+	zb_img_swp_info *info = &step->info;
+	int n_fr = 0, n_to = 0, n, s = cmd->cmd3, rem;
+
+	step->phase = cmd->cmd2 & ~CMD2_MASK_INPLACE;
+	step->sect = cmd->cmd3;
+	if (info->loaded) {
+		n_fr = zb_sector_cnt(area, info->fr.end - info->fr.hdr_start);
+		if (info->to.is_valid) {
+			n_to = zb_sector_cnt(area, info->to.end -
+						   info->to.hdr_start);
+		}
+	}
+	n = MAX(n_fr, n_to);
+
+	/* the sector steps end with a step that finds no more sectors,
+	 * followed by phase 3 and phase 4
+	 */
+	switch (step->phase) {
+	case CMD2_SWP_START:
+		rem = 1 + n_to + 2 * n + 3;
+		break;
+	case CMD2_MOVE_UP:
+		rem = s + 1 + 2 * n + 3;
+		break;
+	case CMD2_SWP_P1:
+		rem = 2 * (n - s) + 3;
+		break;
+	case CMD2_SWP_P2:
+		if (cmd->cmd2 & CMD2_MASK_INPLACE) {
+			rem = n_fr - s + 3;
+		} else {
+			rem = 2 * (n - s) + 2;
+		}
+		break;
+	case CMD2_SCR_P1:
+		rem = 2 * (n_fr - s) + 3;
+		break;
+	case CMD2_SCR_P2:
+		rem = 2 * (n_fr - s) + 2;
+		break;
+	case CMD2_SWP_P3:
+		rem = 2;
+		break;
+	default:
+		rem = 1;
+		break;
+	}
+	step->remaining = MAX(rem, 1);
+}
+
+/* Finish a swap, a rejected image is restored when possible */
+static int zb_img_swap_end(struct zb_slt_area *area, zb_img_swp_step *step,
+			   struct zb_cmd *cmd)
+{
+	int rc;
+
+	if (cmd->cmd2 & CMD2_MASK_INPLACE) {
+		LOG_INF("Finished inplace swap");
+	} else {
+		LOG_INF("Finished classic swap");
+	}
+
+	step->phase = CMD2_SWP_END;
+	step->remaining = 0;
+	if (!step->rejected) {
+		return 0;
+	}
+
+	/* installed image rejected, restore when possible */
+	rc = zb_img_swap_begin(area, step);
+	if (rc || (step->phase == CMD2_SWP_END)) {
+		return rc;
+	}
+	return -EAGAIN;
+}
+
+int zb_img_swap_step(struct zb_slt_area *area, zb_img_swp_step *step)
+{
+	zb_img_swp_info *info = &step->info;
 	int rc;
 	struct zb_cmd cmd;
 	zb_move_cmd mcmd;
-	off_t cmd_off, addr;
-	size_t len, end_fr, end_to;
+	off_t cmd_off, nxt_off, addr;
+	size_t len, end_fr, end_to, sect_size;
 	bool inplace = false;
 
-	while (1) {
-		rc = zb_cmd_read_swpstat(area, &cmd);
+	rc = zb_cmd_read_swpstat(area, &cmd);
 
-		if (rc || (cmd.cmd1 == CMD1_ERROR) ||
-		    ((cmd.cmd2 & ~CMD2_MASK_INPLACE) < CMD2_SWP_START) ||
-		    ((cmd.cmd2 & ~CMD2_MASK_INPLACE) >= CMD2_SWP_END)) {
-			break;
-		}
-
-		cmd_off = cmd.cmd3 * SECTOR_SIZE;
+	if (rc || (cmd.cmd1 == CMD1_ERROR) ||
+	    ((cmd.cmd2 & ~CMD2_MASK_INPLACE) < CMD2_SWP_START) ||
+	    ((cmd.cmd2 & ~CMD2_MASK_INPLACE) >= CMD2_SWP_END)) {
+		return zb_img_swap_end(area, step, &cmd);
+	}
 
-		if (!info->loaded) {
-			rc = zb_get_img_swp_info(info, cmd, area);
-			if (rc) {
-				LOG_INF("Error in image info");
-				/* stop swap */
-				cmd.cmd1 = CMD1_ERROR;
-			}
-		}
+	cmd_off = zb_sector_offset(area, cmd.cmd3, &sect_size);
+	nxt_off = cmd_off + sect_size;
 
-		end_fr = info->fr.end - info->fr .hdr_start;
-		if (info->to.is_valid) {
-			end_to = info->to.end - info->to.hdr_start;
-		} else {
-			end_to = 0;
+	if (!info->loaded) {
+		rc = zb_get_img_swp_info(info, cmd, area);
+		if (rc) {
+			LOG_INF("Error in image info");
+			/* stop swap */
+			cmd.cmd1 = CMD1_ERROR;
 		}
+	}
 
-		if (cmd.cmd2 & CMD2_MASK_INPLACE) {
-			inplace = true;
-		}
-		cmd.cmd2 &= ~CMD2_MASK_INPLACE;
+	end_fr = info->fr.end - info->fr .hdr_start;
+	if (info->to.is_valid) {
+		end_to = info->to.end - info->to.hdr_start;
+	} else {
+		end_to = 0;
+	}
 
- 		switch (cmd.cmd2) {
+	if (cmd.cmd2 & CMD2_MASK_INPLACE) {
+		inplace = true;
+	}
+	cmd.cmd2 &= ~CMD2_MASK_INPLACE;
 
-			case CMD2_SWP_START: /* start move */
-				LOG_INF("Start move");
-				cmd.cmd3 = 0;
-				if ((inplace) &&
-				    (info->fr.enc_start == info->fr.end)) {
-					/* no need to do move for unencrypted
-					 * images that remain in slot1
-					 */
-					LOG_INF("No move required");
-					cmd.cmd2 = CMD2_SWP_P3;
-					break;
-				}
-				if (end_to == 0) {
-					/* no need to do move up when there is
-					 * no image in slt0
-					 * instead schedule swap
-					 */
-					LOG_INF("Move up not required");
-					cmd.cmd2 = CMD2_SWP_P1;
-					break;
-				}
-				addr = info->to.hdr_start;
-				while ((addr + SECTOR_SIZE) < info->to.end) {
-					cmd.cmd3++;
-					addr += SECTOR_SIZE;
-				}
-				/* schedule move_up */
-				cmd.cmd2 = CMD2_MOVE_UP;
-				break;
+	switch (cmd.cmd2) {
 
-			case CMD2_MOVE_UP: /* move up to sectors */
-				LOG_INF("Move up [sector:%d]", cmd.cmd3);
-				/* erase sector cmd.sector+1 */
-				zb_sector_erase(&(info->to), cmd_off +
-						SECTOR_SIZE);
-				/* copy sector cmd.sector to cmd.sector+1 */
-				set_mcmd_moveup(&mcmd, info, cmd_off);
-				zb_img_move(&mcmd, SECTOR_SIZE, false);
-				/* until cmd.sector = 0 */
-				if (cmd.cmd3 == 0) {
-					if (inplace) {
-						cmd.cmd2 = CMD2_SWP_P2;
-					} else {
-						cmd.cmd2 = CMD2_SWP_P1;
-					}
-				} else {
-					cmd.cmd3 -= 1;
+		case CMD2_SWP_START: /* start move */
+			LOG_INF("Start move");
+			cmd.cmd3 = 0;
+			if ((inplace) &&
+			    (info->fr.enc_start == info->fr.end)) {
+				/* no need to do move for unencrypted
+				 * images that remain in slot1, the sectors
+				 * are checked here as they are not moved
+				 */
+				LOG_INF("No move required");
+				if (zb_img_swp_inplace_chk(area, info)) {
+					cmd.cmd1 |= CMD1_MASK_SECT_ERR;
 				}
+				cmd.cmd2 = CMD2_SWP_P3;
 				break;
-			/* Swap sectors */
-			case CMD2_SWP_P1: /* Move from 1 to 0 */
-				if (cmd_off >= end_fr) {
-					if (cmd_off >= end_to) {
-						cmd.cmd2 = CMD2_SWP_P3;
-					} else {
-						cmd.cmd2 = CMD2_SWP_P2;
-					}
-					break;
-				}
-				LOG_INF("Swap phase 1 [sector:%d]", cmd.cmd3);
-				/* erase to sector */
-				zb_sector_erase(&(info->to), cmd_off);
-				/* copy cmd.sector from fr_slt to to_slt
-				 * doing decryption if required
+			}
+			if (inplace && area->scratch_cnt) {
+				/* decrypt sector by sector using
+				 * scratch, no move up
 				 */
-				set_mcmd_swp_p1(&mcmd, info, cmd_off);
-				len = MIN(end_fr - cmd_off, SECTOR_SIZE);
-				zb_img_move(&mcmd, len, false);
-				cmd.cmd2 = CMD2_SWP_P2;
+				cmd.cmd2 = CMD2_SCR_P1;
 				break;
-			case CMD2_SWP_P2: /* Move from 0 to 1 or 1 to 1 */
-				if (cmd_off >= end_to) {
-					if (cmd_off >= end_fr) {
-						cmd.cmd2 = CMD2_SWP_P3;
-					} else {
-						cmd.cmd2 = CMD2_SWP_P1;
-						cmd.cmd3++;
-					}
-					break;
-				}
-				LOG_INF("Swap phase 2 [sector:%d]", cmd.cmd3);
-				/* erase fr sector */
-				zb_sector_erase(&(info->fr), cmd_off);
-				/* copy cmd.sector+1 from to_slt to cmd.sector
-				 * in fr_slt doing decryption if required
+			}
+			if (end_to == 0) {
+				/* no need to do move up when there is
+				 * no image in slt0
+				 * instead schedule swap
 				 */
-				set_mcmd_swp_p2(&mcmd, info, cmd_off);
-				len = MIN(end_to - cmd_off, SECTOR_SIZE);
-				zb_img_move(&mcmd, len, false);
+				LOG_INF("Move up not required");
+				cmd.cmd2 = CMD2_SWP_P1;
+				break;
+			}
+			addr = info->to.hdr_start;
+			(void)zb_sector_offset(area, 0, &len);
+			while ((addr + len) < info->to.end) {
 				cmd.cmd3++;
+				addr += len;
+				(void)zb_sector_offset(area, cmd.cmd3, &len);
+			}
+			/* schedule move_up */
+			cmd.cmd2 = CMD2_MOVE_UP;
+			break;
+
+		case CMD2_MOVE_UP: /* move up to sectors */
+			LOG_INF("Move up [sector:%d]", cmd.cmd3);
+			/* erase sector cmd.sector+1 */
+			(void)zb_sector_offset(area, cmd.cmd3 + 1, &len);
+			zb_sector_erase(&(info->to), nxt_off, len);
+			/* copy sector cmd.sector to cmd.sector+1 */
+			set_mcmd_moveup(&mcmd, info, cmd_off, nxt_off);
+			zb_img_move(&mcmd, sect_size, false);
+			/* until cmd.sector = 0 */
+			if (cmd.cmd3 == 0) {
 				if (inplace) {
 					cmd.cmd2 = CMD2_SWP_P2;
 				} else {
 					cmd.cmd2 = CMD2_SWP_P1;
 				}
-				break;
-			case CMD2_SWP_P3:
-				LOG_INF("Swap phase 3 [slot0 end]");
-				zb_erase_slt0end(area);
-				if (inplace) {
-					cmd.cmd2 |= CMD2_MASK_INPLACE;
+			} else {
+				cmd.cmd3 -= 1;
+			}
+			break;
+		/* Swap sectors */
+		case CMD2_SWP_P1: /* Move from 1 to 0 */
+			if (cmd_off >= end_fr) {
+				if (cmd_off >= end_to) {
+					cmd.cmd2 = CMD2_SWP_P3;
+				} else {
+					cmd.cmd2 = CMD2_SWP_P2;
 				}
-				zb_img_cmd_proc_p3_wrt(area, cmd);
-				cmd.cmd2 = CMD2_SWP_P4;
 				break;
-			case CMD2_SWP_P4:
-				LOG_INF("Swap phase 4 [slot1 end]");
-				zb_erase_slt1end(area);
-				if (inplace) {
-					cmd.cmd2 |= CMD2_MASK_INPLACE;
+			}
+			LOG_INF("Swap phase 1 [sector:%d]", cmd.cmd3);
+			set_mcmd_swp_p1(&mcmd, info, cmd_off);
+			if (zb_img_swp_sect_chk(info, mcmd.fr_off,
+						cmd.cmd3)) {
+				cmd.cmd1 |= CMD1_MASK_SECT_ERR;
+			}
+			/* erase to sector */
+			zb_sector_erase(&(info->to), cmd_off, sect_size);
+			/* copy cmd.sector from fr_slt to to_slt
+			 * doing decryption if required
+			 */
+			len = MIN(end_fr - cmd_off, sect_size);
+			if (!info->fr.is_cmp) {
+				zb_img_move(&mcmd, len, false);
+			} else if (zb_img_unpack(&mcmd, info,
+						 cmd_off, len)) {
+				LOG_ERR("Bad compressed data");
+				cmd.cmd1 |= CMD1_MASK_SECT_ERR;
+			}
+			cmd.cmd2 = CMD2_SWP_P2;
+			break;
+		case CMD2_SWP_P2: /* Move from 0 to 1 or 1 to 1 */
+			if (cmd_off >= end_to) {
+				if (cmd_off >= end_fr) {
+					cmd.cmd2 = CMD2_SWP_P3;
+				} else {
+					cmd.cmd2 = CMD2_SWP_P1;
+					cmd.cmd3++;
 				}
-				zb_img_cmd_proc_p4_wrt(area, cmd);
-				cmd.cmd2 = CMD2_SWP_END;
 				break;
-		}
-		if (inplace) {
-			cmd.cmd2 |= CMD2_MASK_INPLACE;
-		}
-		rc = zb_cmd_write_swpstat(area, &cmd);
+			}
+			LOG_INF("Swap phase 2 [sector:%d]", cmd.cmd3);
+			set_mcmd_swp_p2(&mcmd, info, cmd_off, nxt_off);
+			if (inplace &&
+			    zb_img_swp_sect_chk(info, mcmd.fr_off,
+						cmd.cmd3)) {
+				cmd.cmd1 |= CMD1_MASK_SECT_ERR;
+			}
+			/* erase fr sector */
+			zb_sector_erase(&(info->fr), cmd_off, sect_size);
+			/* copy cmd.sector+1 from to_slt to cmd.sector
+			 * in fr_slt doing decryption if required
+			 */
+			len = MIN(end_to - cmd_off, sect_size);
+			zb_img_move(&mcmd, len, false);
+			cmd.cmd3++;
+			if (inplace) {
+				cmd.cmd2 = CMD2_SWP_P2;
+			} else {
+				cmd.cmd2 = CMD2_SWP_P1;
+			}
+			break;
+		case CMD2_SCR_P1: /* Copy from 1 to scratch */
+			if (cmd_off >= end_fr) {
+				cmd.cmd2 = CMD2_SWP_P3;
+				break;
+			}
+			LOG_INF("Scratch phase 1 [sector:%d]", cmd.cmd3);
+			set_mcmd_scr_p1(&mcmd, info, area, cmd_off);
+			if (zb_img_swp_sect_chk(info, mcmd.fr_off,
+						cmd.cmd3)) {
+				cmd.cmd1 |= CMD1_MASK_SECT_ERR;
+			}
+			(void)zb_flash_erase(area->swpstat_fldev,
+					     mcmd.to_off, SECTOR_SIZE);
+			len = MIN(end_fr - cmd_off, SECTOR_SIZE);
+			zb_img_move(&mcmd, len, false);
+			cmd.cmd2 = CMD2_SCR_P2;
+			break;
+		case CMD2_SCR_P2: /* Decrypt from scratch to 1 */
+			LOG_INF("Scratch phase 2 [sector:%d]", cmd.cmd3);
+			set_mcmd_scr_p2(&mcmd, info, area, cmd_off);
+			zb_sector_erase(&(info->fr), cmd_off, SECTOR_SIZE);
+			len = MIN(end_fr - cmd_off, SECTOR_SIZE);
+			zb_img_move(&mcmd, len, false);
+			cmd.cmd3++;
+			cmd.cmd2 = CMD2_SCR_P1;
+			break;
+		case CMD2_SWP_P3:
+			LOG_INF("Swap phase 3 [slot0 end]");
+			zb_erase_slt0end(area);
+			if (inplace) {
+				cmd.cmd2 |= CMD2_MASK_INPLACE;
+			}
+			if (zb_img_cmd_proc_p3_wrt(area, cmd, info) ==
+			    -EBADMSG) {
+				step->rejected = true;
+			}
+			cmd.cmd2 = CMD2_SWP_P4;
+			break;
+		case CMD2_SWP_P4:
+			LOG_INF("Swap phase 4 [slot1 end]");
+			zb_erase_slt1end(area);
+			if (inplace) {
+				cmd.cmd2 |= CMD2_MASK_INPLACE;
+			}
+			zb_img_cmd_proc_p4_wrt(area, cmd);
+			cmd.cmd2 = CMD2_SWP_END;
+			break;
 	}
-
-	rc = zb_cmd_read_swpstat(area,&cmd);
-
-	if (cmd.cmd2 & CMD2_MASK_INPLACE) {
-		LOG_INF("Finished inplace swap");
-	} else {
-		LOG_INF("Finished classic swap");
+	if (inplace) {
+		cmd.cmd2 |= CMD2_MASK_INPLACE;
+	}
+	rc = zb_cmd_write_swpstat(area, &cmd);
+	if (rc) {
+		return rc;
 	}
+	step->done++;
 
-	return 0;
+	if ((cmd.cmd1 == CMD1_ERROR) ||
+	    ((cmd.cmd2 & ~CMD2_MASK_INPLACE) == CMD2_SWP_END)) {
+		return zb_img_swap_end(area, step, &cmd);
+	}
+	zb_img_swp_progress(area, step, &cmd);
+	return -EAGAIN;
 }
 
 int zb_img_swap(struct zb_slt_area *area)
+{
+	bool swapped;
+
+	return zb_img_swap_stat(area, &swapped);
+}
+
+int zb_img_swap_stat(struct zb_slt_area *area, bool *swapped)
+{
+	zb_img_swp_step step;
+	int rc;
+
+	rc = zb_img_swap_begin(area, &step);
+	*swapped = (step.phase != CMD2_SWP_END);
+	while (step.phase != CMD2_SWP_END) {
+		rc = zb_img_swap_step(area, &step);
+		if (rc != -EAGAIN) {
+			break;
+		}
+	}
+	return rc;
+}
+
+int zb_img_swap_begin(struct zb_slt_area *area, zb_img_swp_step *step)
 {
 	int rc;
-	zb_img_swp_info info;
 	struct zb_cmd cmd;
-	bool swap = false;
+	struct zb_idle idle;
+	bool swap = false, pending = false;
 	u8_t slt;
 
+	step->phase = CMD2_SWP_END;
+	step->sect = 0;
+	step->done = 0;
+	step->remaining = 0;
+	step->rejected = false;
+
+	/* Nothing has changed since the last boot that found nothing to do */
+	if (!zb_idle_read(area, &idle)) {
+		LOG_INF("Nothing pending");
+		return 0;
+	}
+
 	/* Swap is needed if:
 	 * a. There was a swap going on
 	 * b. A new swap command is given
@@ -347,7 +1333,7 @@ int zb_img_swap(struct zb_slt_area *area)
 					/* inplace images always permanent */
 					cmd.cmd1 |= CMD1_MASK_SWP_PERM;
 				}
-				cmd.cmd3 = 0x0;
+				cmd.cmd3 = zb_img_scr_start(area);
 				zb_erase_swpstat(area);
 				rc = zb_cmd_write_swpstat(area, &cmd);
 				if (!rc) {
@@ -355,6 +1341,8 @@ int zb_img_swap(struct zb_slt_area *area)
 				}
 			} else {
 				LOG_ERR("Bad Image");
+				/* keep checking the request on each boot */
+				pending = true;
 			}
 		}
 	}
@@ -377,7 +1365,7 @@ int zb_img_swap(struct zb_slt_area *area)
 		if ((!rc) && (!(cmd.cmd1 & CMD1_MASK_SWP_PERM))) {
 			cmd.cmd1 |= CMD1_MASK_SWP_PERM;
 			cmd.cmd2 = CMD2_SWP_START;
-			cmd.cmd3 = 0;
+			cmd.cmd3 = zb_img_scr_start(area);
 			zb_erase_swpstat(area);
 			rc = zb_cmd_write_swpstat(area, &cmd);
 			if (!rc) {
@@ -387,8 +1375,18 @@ int zb_img_swap(struct zb_slt_area *area)
 	}
 
 	if (swap) {
-		info.loaded = false;
-		return zb_img_cmd_proc(&info, area);
+		/* the image info is loaded here to report the remaining steps,
+		 * when this fails the first step stops the swap
+		 */
+		step->info.loaded = false;
+		(void)zb_get_img_swp_info(&step->info, cmd, area);
+		zb_img_swp_progress(area, step, &cmd);
+		return 0;
+	}
+
+	if (!pending) {
+		/* Nothing to do, skip the command scan on the next boot */
+		(void)zb_idle_write(area);
 	}
 
 	return rc;
@@ -401,6 +1399,10 @@ void set_mcmd_ramcopy(zb_move_cmd *mcmd, zb_img_info *info) {
 	mcmd->fr_eoff = info->enc_start;
 	mcmd->fl_dev_fr = info->flash_device;
 	mcmd->to_off = info->load_address;
+	mcmd->key = info->enc_key;
+	mcmd->enc_type = info->enc_type;
+	mcmd->mark = 0U;
+	mcmd->acc = NULL;
 }
 
 int zb_img_ram_move(zb_img_info *info)
@@ -411,10 +1413,87 @@ int zb_img_ram_move(zb_img_info *info)
 	return zb_img_move(&mcmd, info->end - info->start, true);
 }
 
+int zb_img_ram_load(zb_img_info *info, u32_t crc32)
+{
+	zb_move_cmd mcmd;
+	zb_crc_acc acc;
+	int rc;
+
+	set_mcmd_ramcopy(&mcmd, info);
+	zb_crc_acc_init(&acc, info->load_address,
+			info->load_address + info->end - info->start, NULL);
+	mcmd.acc = &acc;
+	rc = zb_img_move(&mcmd, info->end - info->start, true);
+	if (rc) {
+		return rc;
+	}
+
+	if ((!acc.valid) || (acc.off != acc.end) || (acc.crc32 != crc32)) {
+		LOG_ERR("RAM image crc32 mismatch");
+		(void)memset((void *)info->load_address, 0,
+			     info->end - info->start);
+		return -EFAULT;
+	}
+	return 0;
+}
+
+int zb_img_ram_verify(zb_img_info *info, u32_t crc32)
+{
+	if (crc32_ieee((const u8_t *)info->load_address,
+		       info->end - info->start) != crc32) {
+		return -EFAULT;
+	}
+	return 0;
+}
+
+/* segments are copied from the image as it is in flash (unencrypted) */
+void set_mcmd_segcopy(zb_move_cmd *mcmd, zb_img_info *info,
+		      zb_tlv_img_seg *seg) {
+	mcmd->fr_off = info->start + seg->offset;
+	mcmd->fr_eoff = mcmd->fr_off + seg->size;
+	mcmd->fl_dev_fr = info->flash_device;
+	mcmd->to_off = seg->load_address;
+	mcmd->key = info->enc_key;
+	mcmd->enc_type = info->enc_type;
+	mcmd->mark = 0U;
+	mcmd->acc = NULL;
+}
+
+int zb_img_seg_load(zb_img_info *info)
+{
+	zb_move_cmd mcmd;
+	zb_tlv_img_seg *seg;
+	u8_t i;
+	int rc;
+
+	for (i = 0; i < info->seg_cnt; i++) {
+		seg = &info->seg[i];
+		if (!(seg->flags & (SEG_FLAG_LOAD | SEG_FLAG_ZERO))) {
+			continue;
+		}
+		if ((!seg->size) || (!zb_in_ram(seg->load_address)) ||
+		    (!zb_in_ram(seg->load_address + seg->size - 1))) {
+			LOG_ERR("Segment %d outside RAM", i);
+			return -EFAULT;
+		}
+		if (seg->flags & SEG_FLAG_ZERO) {
+			(void)memset((void *)seg->load_address, 0, seg->size);
+			continue;
+		}
+		set_mcmd_segcopy(&mcmd, info, seg);
+		rc = zb_img_move(&mcmd, seg->size, true);
+		if (rc) {
+			return rc;
+		}
+	}
+	return 0;
+}
+
 int zb_img_move(zb_move_cmd *mcmd, size_t len, bool to_ram)
 {
 	u8_t buf[MOVE_BLOCK_SIZE];
 	u8_t ctr[AES_BLOCK_SIZE] = {0U};
+	struct zb_chacha20_ctx cctx;
 	size_t ulen = 0; /* unencrypted length */
 	off_t fr_off, to_off;
 	int j;
@@ -432,8 +1511,19 @@ int zb_img_move(zb_move_cmd *mcmd, size_t len, bool to_ram)
 	 */
 	memset(ctr, 0, AES_BLOCK_SIZE);
 
+	if (mcmd->enc_type == ENC_TYPE_CHACHA20) {
+		/* the chacha20 block counter is derived from the stream
+		 * offset, so decryption can start at any sector
+		 */
+		zb_chacha20_init(&cctx, mcmd->key, NULL);
+		if (!ulen) {
+			zb_chacha20_seek(&cctx, mcmd->fr_off - mcmd->fr_eoff);
+		}
+	}
+
 	fr_off = mcmd->fr_eoff;
-	while ((fr_off < mcmd->fr_off) && (!ulen)) {
+	while ((fr_off < mcmd->fr_off) && (!ulen) &&
+	       (mcmd->enc_type == ENC_TYPE_AES128_CTR)) {
 		/* ctr increment is required */
 		for (j = AES_BLOCK_SIZE; j > 0; --j) {
                 	if (++ctr[j - 1] != 0) {
@@ -455,7 +1545,20 @@ int zb_img_move(zb_move_cmd *mcmd, size_t len, bool to_ram)
 
 		(void)zb_flash_read(mcmd->fl_dev_fr, fr_off, buf, buf_len);
 
-		if (!ulen) {
+		if (mcmd->mark && (fr_off == mcmd->fr_off)) {
+			buf[offsetof(tlv_area_hdr, tlva_type)] |= mcmd->mark;
+		}
+
+		if (to_ram && mcmd->acc) {
+			/* RAM images are checked on the data in flash, that
+			 * remains encrypted for encrypted images
+			 */
+			zb_crc_acc_update(mcmd->acc, to_off, buf, buf_len);
+		}
+
+		if ((!ulen) && (mcmd->enc_type == ENC_TYPE_CHACHA20)) {
+			zb_chacha20_xor(&cctx, buf, buf_len);
+		} else if (!ulen) {
 			(void)zb_aes_ctr_mode(buf, buf_len, ctr, mcmd->key);
 		}
 
@@ -466,6 +1569,10 @@ int zb_img_move(zb_move_cmd *mcmd, size_t len, bool to_ram)
 			(void)memcpy((void *)to_off, buf, buf_len);
 		}
 
+		if ((!to_ram) && mcmd->acc) {
+			zb_crc_acc_update(mcmd->acc, to_off, buf, buf_len);
+		}
+
 		if (ulen) {
 			ulen -= buf_len;
 		}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2019 LaczenJMS.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <errno.h>
+
+#include "../include/zb_tlv.h"
+#include "../include/zb_move.h"
+#include "../include/zb_predec.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(zb_predec);
+
+int zb_img_move(zb_move_cmd *mcmd, size_t len, bool to_ram);
+
+static bool zb_predec_cmd(struct zb_cmd *cmd)
+{
+	return ((cmd->cmd2 >= CMD2_PDC_P1) && (cmd->cmd2 <= CMD2_PDC_END));
+}
+
+/* The header sector is decrypted last, when it is written the image is marked
+ * as pre-decrypted.
+ */
+static u8_t zb_predec_next(struct zb_predec *pdc, u8_t sect)
+{
+	if (sect == 0) {
+		return pdc->sect_cnt;
+	}
+	if ((sect + 1) < pdc->sect_cnt) {
+		return sect + 1;
+	}
+	return 0;
+}
+
+static void zb_predec_info(struct zb_predec *pdc)
+{
+	struct zb_slt_area scr_area;
+	off_t delta;
+
+	if ((pdc->cmd.cmd2 != CMD2_PDC_P2) || (pdc->cmd.cmd3 != 0)) {
+		zb_img_get_info_nsc(&pdc->info, pdc->area, 1, 0, false);
+		return;
+	}
+
+	/* the header is in scratch while sector 0 is decrypted */
+	scr_area = *pdc->area;
+	scr_area.slt1_offset = zb_scratch_offset(pdc->area, pdc->scr_start, 0);
+	scr_area.slt1_fldev = pdc->area->swpstat_fldev;
+	zb_img_get_info_nsc(&pdc->info, &scr_area, 1, 0, false);
+	delta = pdc->area->slt1_offset - scr_area.slt1_offset;
+	pdc->info.hdr_start += delta;
+	pdc->info.start += delta;
+	pdc->info.enc_start += delta;
+	pdc->info.end += delta;
+	pdc->info.flash_device = pdc->area->slt1_fldev;
+}
+
+int zb_predec_init(struct zb_predec *pdc, struct zb_slt_area *area)
+{
+	struct zb_cmd cmd;
+	size_t sect_cnt, step;
+	int rc;
+
+	pdc->area = area;
+	if (!area->scratch_cnt) {
+		return -ENOTSUP;
+	}
+	/* the zb_prm is not changed while the application runs */
+	pdc->scr_start = zb_scratch_start(area);
+
+	rc = zb_cmd_read_slt1end(area, &cmd);
+	if ((!rc) && zb_predec_cmd(&cmd)) {
+		pdc->cmd = cmd;
+		zb_predec_info(pdc);
+		if (!pdc->info.is_valid) {
+			return -EFAULT;
+		}
+		pdc->sect_cnt = (pdc->info.end - pdc->info.hdr_start +
+				 SECTOR_SIZE - 1) / SECTOR_SIZE;
+		if ((cmd.cmd2 != CMD2_PDC_END) || pdc->info.is_predec) {
+			LOG_INF("Continuing pre-decryption");
+			return 0;
+		}
+		/* a new image has been written after a pre-decryption */
+	}
+
+	zb_img_get_info_wsc(&pdc->info, area, 1, 0, true);
+	if (!pdc->info.is_valid) {
+		return -EFAULT;
+	}
+
+	pdc->cmd.cmd2 = CMD2_PDC_END;
+	if (pdc->info.enc_start == pdc->info.end) {
+		/* not encrypted or already pre-decrypted */
+		return 0;
+	}
+
+	if ((!pdc->info.has_phash) || pdc->info.has_cmp ||
+	    zb_in_ram(pdc->info.load_address)) {
+		/* RAM images stay encrypted in flash */
+		return -ENOTSUP;
+	}
+
+	/* the progress is tracked with two commands for each sector */
+	sect_cnt = (pdc->info.end - pdc->info.hdr_start + SECTOR_SIZE - 1) /
+		   SECTOR_SIZE;
+	step = zb_flash_align_size(area->slt1_fldev, sizeof(struct zb_cmd));
+	if ((2 * sect_cnt + 1) * step > SECTOR_SIZE) {
+		return -ENOSPC;
+	}
+	pdc->sect_cnt = sect_cnt;
+
+	/* keep the other requests, the swap is requested when done */
+	cmd.cmd1 = rc ? 0U : cmd.cmd1 & ~CMD1_MASK_SWP_REQUEST;
+	cmd.cmd2 = CMD2_PDC_P1;
+	cmd.cmd3 = (sect_cnt > 1) ? 1 : 0;
+
+	rc = zb_erase_slt1end(area);
+	if (rc) {
+		return rc;
+	}
+	rc = zb_cmd_write_slt1end(area, &cmd);
+	if (rc) {
+		return rc;
+	}
+	LOG_INF("Starting pre-decryption");
+	pdc->cmd = cmd;
+	return 0;
+}
+
+int zb_predec_step(struct zb_predec *pdc)
+{
+	struct zb_slt_area *area = pdc->area;
+	zb_img_info *info = &pdc->info;
+	zb_move_cmd mcmd;
+	off_t secoff;
+	size_t len;
+	int rc;
+
+	if (pdc->cmd.cmd2 == CMD2_PDC_END) {
+		return 0;
+	}
+
+	secoff = pdc->cmd.cmd3 * SECTOR_SIZE;
+	len = MIN(info->end - info->hdr_start - secoff, SECTOR_SIZE);
+	mcmd.key = info->enc_key;
+	mcmd.enc_type = info->enc_type;
+	mcmd.mark = 0U;
+	mcmd.acc = NULL;
+
+	switch (pdc->cmd.cmd2) {
+	case CMD2_PDC_P1: /* Copy from slt1 to scratch */
+		LOG_INF("Pre-decryption phase 1 [sector:%d]", pdc->cmd.cmd3);
+		mcmd.fr_off = info->hdr_start + secoff;
+		mcmd.fr_eoff = mcmd.fr_off + SECTOR_SIZE;
+		mcmd.fl_dev_fr = info->flash_device;
+		mcmd.to_off = zb_scratch_offset(area, pdc->scr_start,
+						pdc->cmd.cmd3);
+		mcmd.fl_dev_to = area->swpstat_fldev;
+		rc = zb_flash_erase(mcmd.fl_dev_to, mcmd.to_off, SECTOR_SIZE);
+		if (rc) {
+			return rc;
+		}
+		zb_img_move(&mcmd, len, false);
+		pdc->cmd.cmd2 = CMD2_PDC_P2;
+		break;
+	case CMD2_PDC_P2: /* Decrypt from scratch to slt1 */
+		LOG_INF("Pre-decryption phase 2 [sector:%d]", pdc->cmd.cmd3);
+		mcmd.fr_off = zb_scratch_offset(area, pdc->scr_start,
+						pdc->cmd.cmd3);
+		mcmd.fr_eoff = mcmd.fr_off - secoff + info->enc_start -
+			       info->hdr_start;
+		mcmd.fl_dev_fr = area->swpstat_fldev;
+		mcmd.to_off = info->hdr_start + secoff;
+		mcmd.fl_dev_to = info->flash_device;
+		if (pdc->cmd.cmd3 == 0) {
+			mcmd.mark = TLVA_TYPE_DECRYPTED;
+		}
+		rc = zb_flash_erase(mcmd.fl_dev_to, mcmd.to_off, SECTOR_SIZE);
+		if (rc) {
+			return rc;
+		}
+		zb_img_move(&mcmd, len, false);
+		pdc->cmd.cmd3 = zb_predec_next(pdc, pdc->cmd.cmd3);
+		pdc->cmd.cmd2 = CMD2_PDC_P1;
+		if (pdc->cmd.cmd3 == pdc->sect_cnt) {
+			pdc->cmd.cmd2 = CMD2_PDC_END;
+			pdc->cmd.cmd3 = 0;
+		}
+		break;
+	default:
+		return -EFAULT;
+	}
+
+	rc = zb_cmd_write_slt1end(area, &pdc->cmd);
+	if (rc) {
+		return rc;
+	}
+
+	if (pdc->cmd.cmd2 == CMD2_PDC_END) {
+		LOG_INF("Finished pre-decryption");
+		return 0;
+	}
+	return -EAGAIN;
+}
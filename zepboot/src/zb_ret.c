@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2019 LaczenJMS.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <errno.h>
+#include <crc.h>
+
+#include "../include/zb_ret.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(zb_ret);
+
+static u32_t zb_ret_crc32(struct zb_ret *ret)
+{
+	return crc32_ieee((const u8_t *)ret, offsetof(struct zb_ret, crc32));
+}
+
+int zb_ret_read(struct zb_ret *ret)
+{
+	if ((ret->magic != ZB_RET_MAGIC) || (ret->crc32 != zb_ret_crc32(ret))) {
+		return -ENOENT;
+	}
+	return 0;
+}
+
+void zb_ret_write(struct zb_ret *ret, off_t boot_address, u32_t img_crc32,
+		  u32_t vfy_sect)
+{
+	ret->magic = ZB_RET_MAGIC;
+	ret->boot_address = boot_address;
+	ret->img_crc32 = img_crc32;
+	ret->vfy_sect = vfy_sect;
+	ret->crc32 = zb_ret_crc32(ret);
+}
+
+void zb_ret_clear(struct zb_ret *ret)
+{
+	memset(ret, 0, sizeof(struct zb_ret));
+}
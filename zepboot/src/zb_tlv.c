@@ -10,16 +10,35 @@
 #include <errno.h>
 #include "../include/zb_flash.h"
 #include "../include/zb_tlv.h"
+#include "../include/zb_ed25519.h"
 
 #include <logging/log.h>
 LOG_MODULE_REGISTER(zb_tlv);
 
+/* Get the key id hint, the hint is only used to select the root key */
+static const u8_t *zb_tlv_key_id(const void *data, size_t tlv_size)
+{
+	tlv_entry entry;
+	off_t offset = 0;
+
+	entry.type = 0;
+	while ((entry.type != TLVE_KEY_ID) && (offset < tlv_size)) {
+		zb_step_tlv(data, &offset, &entry);
+	}
+	if ((entry.type != TLVE_KEY_ID) || (entry.length != TLVE_KEY_ID_BYTES) ||
+	    (offset > tlv_size)) {
+		return NULL;
+	}
+	return entry.value;
+}
+
 int zb_open_tlv_area(struct device *flash_dev, off_t offset, void *data,
 		     bool validate)
 {
 	int rc;
 	tlv_area_hdr hdr;
 	u8_t hash[HASH_BYTES];
+	struct zb_hash_ctx ctx;
 	off_t data_off;
 	size_t tlv_size = 0;
 
@@ -35,23 +54,42 @@ int zb_open_tlv_area(struct device *flash_dev, off_t offset, void *data,
 	data_off = offset + sizeof(tlv_area_hdr);
 	tlv_size = (size_t)hdr.tlva_size - sizeof(tlv_area_hdr);
 
+	rc = zb_flash_read(flash_dev, data_off, data, tlv_size);
+	if (rc) {
+	 	return rc;
+	}
+
 	if (validate) {
-		rc = zb_hash_flash(hash, flash_dev, data_off, tlv_size);
+		/* Hash the data that was read, not a second read of flash */
+		rc = zb_hash_init(&ctx, HASH_TYPE_SHA256);
+		if (!rc) {
+			rc = zb_hash_update(&ctx, data, tlv_size);
+		}
+		if (!rc) {
+			rc = zb_hash_final(hash, &ctx);
+		}
 		if (rc) {
 			return rc;
 		}
 
-		rc = zb_sign_verify(hash, hdr.tlva_signature);
+		switch (hdr.tlva_sig_type) {
+		case TLVA_SIG_TYPE_EC256:
+			rc = zb_sign_verify_id(hash, hdr.tlva_signature,
+					       zb_tlv_key_id(data, tlv_size));
+			break;
+		case TLVA_SIG_TYPE_ED25519:
+			rc = zb_ed25519_sign_verify(hash, hdr.tlva_signature,
+						    zb_tlv_key_id(data,
+								  tlv_size));
+			break;
+		default:
+			rc = -EFAULT;
+		}
 		if (rc) {
 			return -EFAULT;
 		}
 	}
 
-	rc = zb_flash_read(flash_dev, data_off, data, tlv_size);
-	if (rc) {
-	 	return rc;
-	}
-
 	return (int)tlv_size;
 }
 